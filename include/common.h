@@ -24,6 +24,9 @@
 #define NUM_PAGES (1 << (ADDRESS_SIZE - OFFSET_LEN))
 #define PAGE_SIZE (1 << OFFSET_LEN)
 
+#define VREG_SZ 32 /* bytes held by the READV/WRITEV vector register */
+#define LOOP_MAX_DEPTH 8 /* nesting limit of repeat ... end */
+
 enum ins_opcode_t
 {
 	CALC,  // Just perform calculation, only use CPU
@@ -32,6 +35,14 @@ enum ins_opcode_t
 	READ,  // Write data to a byte on memory
 	WRITE, // Read data from a byte on memory
 	SYSCALL,
+	MEMSET, // Fill a byte range of a region with a value
+	MEMCPY, // Copy a byte range between two regions
+	READW,  // Read a 8/16/32/64-bit little endian word
+	WRITEW, // Write a 8/16/32/64-bit little endian word
+	READV,  // Load up to VREG_SZ bytes into the vector register
+	WRITEV, // Store bytes of the vector register
+	REPEAT, // Open a counted loop, resolved by run() without a time slot
+	END,    // Close the innermost counted loop
 };
 
 /* instructions executed by the CPU */
@@ -42,6 +53,7 @@ struct inst_t
 	uint32_t arg_1;
 	uint32_t arg_2;
 	uint32_t arg_3;
+	uint32_t arg_4;
 };
 
 struct code_seg_t
@@ -73,32 +85,52 @@ struct page_table_t
 	int size; // Number of row in the first layer
 };
 
-/* PCB, describe information about a process */
-struct pcb_t
+/* Cold part of a PCB: only touched when the process is loaded, moved
+ * between queues, killed or torn down, so it is kept off the dispatch path */
+struct pcb_cold_t
 {
-	uint32_t pid;		 // PID
-	uint32_t priority;	 // Default priority, this legacy process based (FIXED)
 	char path[100];
-	struct code_seg_t *code; // Code segment
 	addr_t regs[10];	 // Registers, store address of allocated regions
-	uint32_t pc;		 // Program pointer, point to the next instruction
 	struct queue_t *ready_queue;
 	struct queue_t *running_list;
 #ifdef MLQ_SCHED
 	struct queue_t *mlq_ready_queue;
+#endif
+#ifdef MM_PAGING
+	struct memphy_struct **mswp;
+	uint32_t active_mswp_id;
+	struct mm_struct mm_store;	 // Backing store of pcb_t.mm
+#endif
+	struct page_table_t *page_table; // Page table
+	uint32_t bp;			 // Break pointer
+	BYTE vreg[VREG_SZ];		 // Vector register of READV/WRITEV
+	uint32_t loop_cnt[LOOP_MAX_DEPTH]; // Iterations left per loop depth
+	struct code_seg_t code_store;	 // Backing store of pcb_t.code
+	uint32_t text_cap;		 // Capacity of code_store.text, kept across reuse
+};
+
+/* PCB, describe information about a process
+ * Hot part: everything the dispatcher and run() read on every time slot,
+ * packed in one cache line. PCBs live in a slab grown by pages, see
+ * alloc_pcb() in loader.c */
+struct pcb_t
+{
+	uint32_t pid;		 // PID
+	uint32_t pc;		 // Program pointer, point to the next instruction
+	uint32_t priority;	 // Default priority, this legacy process based (FIXED)
+#ifdef MLQ_SCHED
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
 	uint32_t prio;
 #endif
+	struct code_seg_t *code; // Code segment
 #ifdef MM_PAGING
 	struct mm_struct *mm;
 	struct memphy_struct *mram;
-	struct memphy_struct **mswp;
 	struct memphy_struct *active_mswp;
-	uint32_t active_mswp_id;
 #endif
-	struct page_table_t *page_table; // Page table
-	uint32_t bp;			 // Break pointer
-};
+	uint32_t stall;		 // Extra slots the last instruction still occupies
+	struct pcb_cold_t *cold;
+} __attribute__((aligned(PCB_CACHELINE_SZ)));
 
 #endif
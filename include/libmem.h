@@ -18,8 +18,16 @@
 
 extern struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 int inc_vma_limit(struct pcb_t*, int, int);
-int __mm_swap_page(struct pcb_t*, int, int);
-int liballoc(struct pcb_t *, uint32_t, uint32_t);
+int __mm_swap_page(struct pcb_t*, int, int, int);
+int liballoc(struct pcb_t *, uint32_t, uint32_t, uint32_t);
 int libfree(struct pcb_t *, uint32_t);
 int libread(struct pcb_t*, uint32_t, uint32_t, uint32_t*);
 int libwrite(struct pcb_t*, BYTE, uint32_t, uint32_t);
+int libmemset(struct pcb_t*, uint32_t, uint32_t, uint32_t, BYTE);
+int libreadw(struct pcb_t*, uint32_t, uint32_t, uint32_t, uint64_t*);
+int libwritew(struct pcb_t*, uint64_t, uint32_t, uint32_t, uint32_t);
+int libreadv(struct pcb_t*, uint32_t, uint32_t, uint32_t, BYTE*);
+int libwritev(struct pcb_t*, const BYTE*, uint32_t, uint32_t, uint32_t);
+int libmemcpy(struct pcb_t*, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
+int free_pcb_memph(struct pcb_t*);
+int fork_pcb_memph(struct pcb_t*, struct pcb_t*);
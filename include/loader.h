@@ -5,5 +5,9 @@
 
 struct pcb_t * load(const char * path);
 
+struct pcb_t * alloc_pcb(void);
+struct pcb_t * dup_pcb(struct pcb_t * proc);
+void free_pcb(struct pcb_t * proc);
+
 #endif
 
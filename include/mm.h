@@ -5,13 +5,28 @@
 
 /* CPU Bus definition */
 #define PAGING_CPU_BUS_WIDTH 22 /* 22bit bus - MAX SPACE 4MB */
-#define PAGING_PAGESZ  256      /* 256B or 8-bits PAGE NUMBER */
+/* Page size, chosen per run, see mm_set_pagesz. 256B by default */
+extern int paging_pgshift;
+#define PAGING_PGSHIFT_MIN 8  /* 256B */
+#define PAGING_PGSHIFT_MAX 16 /* 64KB */
+#define PAGING_PAGESZ  (1 << paging_pgshift)
 #define PAGING_MEMRAMSZ BIT(21)
 #define PAGING_PAGE_ALIGNSZ(sz) (DIV_ROUND_UP(sz,PAGING_PAGESZ)*PAGING_PAGESZ)
 
 #define PAGING_MEMSWPSZ BIT(29)
-#define PAGING_SWPFPN_OFFSET 5  
-#define PAGING_MAX_PGN  (DIV_ROUND_UP(BIT(PAGING_CPU_BUS_WIDTH),PAGING_PAGESZ))
+#define PAGING_SWPFPN_OFFSET 2
+#define PAGING_MAX_PGN  (BIT(PAGING_CPU_BUS_WIDTH) >> paging_pgshift)
+
+/* Two level page table, the pgd points to page table pages of
+ * PAGING_PGT_NENT PTEs each, allocated when a PTE in them is first set */
+#define PAGING_PGT_BITS 8
+#define PAGING_PGT_NENT BIT(PAGING_PGT_BITS)
+#define PAGING_PGD_NENT DIV_ROUND_UP(PAGING_MAX_PGN,PAGING_PGT_NENT)
+
+/* Large page: PAGING_LPAGE_NR pages aligned alike in virtual and
+ * physical space, mapped by one fault and one TLB entry, see pg_lmap */
+#define PAGING_LPAGE_ORDER 4
+#define PAGING_LPAGE_NR BIT(PAGING_LPAGE_ORDER)
 
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
 /* PTE BIT */
@@ -19,12 +34,28 @@
 #define PAGING_PTE_SWAPPED_MASK BIT(30)
 #define PAGING_PTE_RESERVE_MASK BIT(29)
 #define PAGING_PTE_DIRTY_MASK BIT(28)
-#define PAGING_PTE_EMPTY01_MASK BIT(14)
-#define PAGING_PTE_EMPTY02_MASK BIT(13)
+#define PAGING_PTE_EMPTY01_MASK BIT(25) /* above SWPOFF, free whatever the PTE holds */
+#define PAGING_PTE_EMPTY02_MASK BIT(24)
 
 /* PTE BIT PRESENT */
 #define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
 #define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK)
+#define PAGING_PAGE_SWAPPED(pte) (pte&PAGING_PTE_SWAPPED_MASK)
+
+/* Reference bit of resident pages, for CLOCK and the LRU approximation */
+#define PAGING_PTE_REF_MASK PAGING_PTE_EMPTY01_MASK
+
+/* Copy on write, the frame may be shared with a forked mm */
+#define PAGING_PTE_COW_MASK PAGING_PTE_RESERVE_MASK
+
+/* Page of a shared memory segment, faults in through the segment */
+#define PAGING_PTE_SHM_MASK PAGING_PTE_EMPTY02_MASK
+
+/* Page of a large page block, in the unused top USRNUM bit */
+#define PAGING_PTE_LARGE_MASK BIT(PAGING_PTE_USRNUM_HIBIT)
+
+/* Page read ahead of a sequential fault and not used yet, next USRNUM bit */
+#define PAGING_PTE_RA_MASK BIT(PAGING_PTE_USRNUM_HIBIT - 1)
 
 /* USRNUM */
 #define PAGING_PTE_USRNUM_LOBIT 15
@@ -32,12 +63,12 @@
 /* FPN */
 #define PAGING_PTE_FPN_LOBIT 0
 #define PAGING_PTE_FPN_HIBIT 12
-/* SWPTYP */
+/* SWPTYP, one of PAGING_MAX_MMSWP devices */
 #define PAGING_PTE_SWPTYP_LOBIT 0
-#define PAGING_PTE_SWPTYP_HIBIT 4
-/* SWPOFF */
-#define PAGING_PTE_SWPOFF_LOBIT 5
-#define PAGING_PTE_SWPOFF_HIBIT 25
+#define PAGING_PTE_SWPTYP_HIBIT 1
+/* SWPOFF, a slot of up to PAGING_MEMSWPSZ with the smallest pages */
+#define PAGING_PTE_SWPOFF_LOBIT 2
+#define PAGING_PTE_SWPOFF_HIBIT 22
 
 /* PTE */
 #define PAGING_PTE_USRNUM_MASK GENMASK(PAGING_PTE_USRNUM_HIBIT,PAGING_PTE_USRNUM_LOBIT)
@@ -50,21 +81,22 @@
 #define PAGING_PTE_PGN(pte)   GETVAL(pte,PAGING_PGN_MASK,PAGING_ADDR_PGN_LOBIT)
 #define PAGING_PTE_FPN(pte)   GETVAL(pte,PAGING_PTE_FPN_MASK,PAGING_PTE_FPN_LOBIT)
 #define PAGING_PTE_SWP(pte)   GETVAL(pte,PAGING_PTE_SWPOFF_MASK,PAGING_SWPFPN_OFFSET)
+#define PAGING_PTE_SWPTYP(pte) GETVAL(pte,PAGING_PTE_SWPTYP_MASK,PAGING_PTE_SWPTYP_LOBIT)
 
 /* OFFSET */
 #define PAGING_ADDR_OFFST_LOBIT 0
-#define PAGING_ADDR_OFFST_HIBIT (NBITS(PAGING_PAGESZ) - 1)
+#define PAGING_ADDR_OFFST_HIBIT (paging_pgshift - 1)
 
 /* PAGE Num */
-#define PAGING_ADDR_PGN_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_ADDR_PGN_LOBIT paging_pgshift
 #define PAGING_ADDR_PGN_HIBIT (PAGING_CPU_BUS_WIDTH - 1)
 
 /* Frame PHY Num */
-#define PAGING_ADDR_FPN_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_ADDR_FPN_LOBIT paging_pgshift
 #define PAGING_ADDR_FPN_HIBIT (NBITS(PAGING_MEMRAMSZ) - 1)
 
 /* SWAPFPN */
-#define PAGING_SWP_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_SWP_LOBIT paging_pgshift
 #define PAGING_SWP_HIBIT (NBITS(PAGING_MEMSWPSZ) - 1)
 #define PAGING_SWP(pte) ((pte&PAGING_PTE_SWPOFF_MASK) >> PAGING_SWPFPN_OFFSET)
 
@@ -107,6 +139,9 @@ int alloc_pages_range(struct pcb_t *caller, int incpgnum, struct framephy_struct
 int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                 struct memphy_struct *mpdst, int dstfpn) ;
 int pte_set_fpn(uint32_t *pte, int fpn);
+uint32_t *pte_ptr(struct mm_struct *mm, int pgn, int alloc);
+uint32_t pte_get(struct mm_struct *mm, int pgn);
+uint32_t *pte_map(struct mm_struct *mm, int pgn);
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff);
 int init_pte(uint32_t *pte,
              int pre,    // present
@@ -116,10 +151,31 @@ int init_pte(uint32_t *pte,
              int swptyp, // swap type
              int swpoff); //swap offset
 int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr);
+int __populate(struct pcb_t *caller, int addr, int size);
 int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value);
+int __read_range(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *buf, int len);
+int __write_range(struct pcb_t *caller, int vmaid, int rgid, int offset, const BYTE *buf, int len);
+int __memset(struct pcb_t *caller, int vmaid, int rgid, int offset, int len, BYTE value);
+int __memcpy(struct pcb_t *caller, int vmaid, int dstrg, int dstoff, int srcrg, int srcoff, int len);
+int pg_getrange(struct mm_struct *mm, int addr, BYTE *buf, int len, struct pcb_t *caller);
+int pg_setrange(struct mm_struct *mm, int addr, const BYTE *buf, BYTE value, int len, struct pcb_t *caller);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+int mm_set_pagesz(int size);
+int tlb_lookup(struct mm_struct *mm, int pgn, int *fpn);
+void tlb_fill(struct mm_struct *mm, int pgn, int fpn);
+void tlb_flush_page(struct mm_struct *mm, int pgn);
+void tlb_flush_all(struct mm_struct *mm);
+
+/* Free region bins prototypes */
+void vm_freerg_init(struct vm_freerg_bins *fb);
+void vm_freerg_clear(struct vm_freerg_bins *fb);
+int vm_freerg_insert(struct vm_freerg_bins *fb, struct vm_rg_struct *rg);
+int vm_freerg_take(struct vm_freerg_bins *fb, unsigned long size, struct vm_rg_struct *newrg);
+unsigned long vm_freerg_tail(struct vm_freerg_bins *fb, unsigned long addr);
+unsigned long vm_freerg_frag(struct vm_freerg_bins *fb);
+int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct *rg_elmt);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -139,16 +195,131 @@ struct vm_rg_struct * get_symrg_byid(struct mm_struct* mm, int rgid);
 int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int vmaend);
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz);
-int find_victim_page(struct mm_struct* mm, int *pgn);
+
+extern int mm_demand; /* growing a vma maps no frame, pages fault in */
+extern int mm_lpage;  /* heap growth is mapped with large pages where aligned */
+extern int mm_readahead; /* most swapped pages read ahead of a sequential fault, 0 off */
+int pg_lmap(struct mm_struct *mm, int pgn, struct pcb_t *caller);
+int find_victim_page(struct mm_struct* mm, int pgn, int *retpgn);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *fpn);
+int MEMPHY_get_freerun(struct memphy_struct *mp, int nframes, int *retfpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn);
 int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
+int MEMPHY_read_range(struct memphy_struct *mp, int addr, BYTE *buf, int len);
+int MEMPHY_write_range(struct memphy_struct *mp, int addr, const BYTE *buf, BYTE value, int len);
+int MEMPHY_read_page(struct memphy_struct *mp, int fpn, BYTE *buf);
+int MEMPHY_write_page(struct memphy_struct *mp, int fpn, const BYTE *buf);
+int MEMPHY_copy_frames(struct memphy_struct *mpsrc, int srcfpn,
+                       struct memphy_struct *mpdst, int dstfpn, int nframes);
 int MEMPHY_dump(struct memphy_struct * mp);
+int MEMPHY_set_seek_rate(struct memphy_struct *mp, int rate);
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
+int init_memphy_file(struct memphy_struct *mp, int max_size, int randomflg, const char *path);
+int MEMPHY_set_owner(struct memphy_struct *mp, int fpn, struct mm_struct *owner, int pgn);
+struct mm_struct *MEMPHY_get_owner(struct memphy_struct *mp, int fpn, int *pgn);
+int MEMPHY_share(struct memphy_struct *mp, int fpn, struct mm_struct *owner, int pgn);
+int MEMPHY_unshare(struct memphy_struct *mp, int fpn, struct mm_struct *owner, int pgn);
+int MEMPHY_get_refcnt(struct memphy_struct *mp, int fpn);
+struct mm_struct *MEMPHY_get_sharer(struct memphy_struct *mp, int fpn, int idx, int *pgn);
+int MEMPHY_drop_owner(struct memphy_struct *mp, struct mm_struct *owner);
+int MEMPHY_set_swpcopy(struct memphy_struct *mp, int fpn, int swptyp, int swpfpn);
+int MEMPHY_get_swpcopy(struct memphy_struct *mp, int fpn, int *swptyp);
+int MEMPHY_take_swpcopy(struct memphy_struct *mp, int fpn, int *swptyp);
+
+/* Page replacement policies */
+struct pgrep_ops {
+   const char *name;
+   void (*insert)(struct mm_struct *mm, int pgn);
+   void (*access)(struct mm_struct *mm, int pgn);
+   int (*victim)(struct mm_struct *mm, int pgn, int *retpgn);
+   void (*remove)(struct mm_struct *mm, int pgn);
+};
+
+extern const struct pgrep_ops *mm_pgrep;
+extern int pgrep_global; /* pick victims among the frames of every mm */
+
+int pgrep_select(const char *name);
+void pgrep_init(struct mm_struct *mm);
+int pgrep_insert(struct mm_struct *mm, int pgn);
+void pgrep_access(struct mm_struct *mm, int pgn);
+int pgrep_global_victim(struct mm_struct *mm, struct memphy_struct *mram,
+                        struct mm_struct **vicmm, int *vicpgn);
+
+/* Swap device placement */
+enum swp_modes { SWP_STRIPE, SWP_LEAST, SWP_TIER };
+
+extern int swp_mode;
+
+int swp_select(const char *name);
+const char *swp_mode_name(void);
+struct memphy_struct *swp_dev(struct pcb_t *caller, int swptyp);
+int swp_alloc(struct pcb_t *caller, int *swptyp, int *swpoff);
+void swp_free(struct pcb_t *caller, int swptyp, int swpoff);
+
+/* Shared memory segments */
+int shm_attach(struct pcb_t *caller, int key, int size, int rgid);
+int shm_detach(struct pcb_t *caller, unsigned long start);
+struct shm_seg *shm_find(struct mm_struct *mm, int pgn, int *idx);
+int shm_fork(struct mm_struct *mm, struct mm_struct *cmm);
+
+/* MM statistics, counters are updated lock free from any CPU */
+struct mm_stats {
+   uint64_t alloc_cnt;     /* __alloc calls */
+   uint64_t alloc_brk_cnt; /* allocations that had to grow the vm area */
+   uint64_t alloc_ns;      /* total __alloc latency */
+   uint64_t alloc_max_ns;
+   uint64_t free_cnt;
+   uint64_t coalesce_cnt;  /* free neighbours merged on free */
+   uint64_t frag_samples;  /* one external fragmentation sample per alloc */
+   uint64_t frag_permille;
+   uint64_t tlb_hit;       /* pg_getpage translations served by the TLB */
+   uint64_t tlb_miss;
+   uint64_t tlb_lhit;      /* of those hits, served by a large page entry */
+   uint64_t pgt_alloc;     /* page table pages allocated */
+   uint64_t pg_access;     /* pg_getpage calls */
+   uint64_t pg_fault;      /* accesses to a page that was not resident */
+   uint64_t pg_evict;      /* victim pages swapped out */
+   uint64_t pg_evict_other;/* victims taken from another mm */
+   uint64_t pg_swapin;     /* pages copied back from swap */
+   uint64_t pg_zerofill;   /* never backed pages given a zeroed frame */
+   uint64_t ra_page;       /* swapped pages read ahead of a sequential fault */
+   uint64_t ra_hit;        /* of those, used before eviction, one fault saved each */
+   uint64_t ra_miss;       /* of those, evicted unused */
+   uint64_t rss_evict;     /* faults of a process at its RSS limit, replaced locally */
+   uint64_t lpage_map;     /* large pages mapped on an aligned frame run */
+   uint64_t lpage_split;   /* large page blocks mapped page by page, no run was free */
+   uint64_t pg_writeback;  /* victim frames copied to swap */
+   uint64_t pg_wb_clean;   /* clean victims whose swap copy was kept, no copy */
+   uint64_t swp_out[PAGING_MAX_MMSWP]; /* pages placed per swap device */
+   uint64_t swp_demote;    /* tier mode pages moved to a slower device */
+   uint64_t fork_cnt;      /* processes forked */
+   uint64_t fork_shared;   /* frames shared copy on write by a fork */
+   uint64_t pg_cow;        /* first writes to a shared frame that copied it */
+   uint64_t mm_teardown;   /* process memories torn down */
+   uint64_t pg_teardown;   /* mapped pages released by those teardowns */
+   uint64_t shm_attach;    /* shared memory segments attached */
+   uint64_t shm_hit;       /* shm faults mapping a frame another mm brought in */
+   uint64_t shm_destroy;   /* segments freed once their last attacher detached */
+   uint64_t dev_seek_bytes;/* distance crossed by sequential device heads */
+   uint64_t dev_seek_slots;/* time slots charged for those seeks */
+};
+
+extern struct mm_stats mmstats;
+
+#ifdef MM_STATS
+#define MM_STAT_ADD(field, n) __atomic_fetch_add(&mmstats.field, (n), __ATOMIC_RELAXED)
+#else
+#define MM_STAT_ADD(field, n) do { } while (0)
+#endif
+#define MM_STAT_INC(field) MM_STAT_ADD(field, 1)
+
+uint64_t mm_stats_now(void);
+void mm_stats_alloc_done(uint64_t ns);
+void mm_stats_dump(struct memphy_struct *mram);
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
@@ -4,11 +4,17 @@
 #define MLQ_SCHED 1
 #define MAX_PRIO 140
 
+#define PCB_SLAB_CHUNK 64 /* PCB slots the slab grows by */
+#define PCB_CACHELINE_SZ 64
+
+#define BULKMEM_SLOT_BYTES 1024 /* bytes MEMSET/MEMCPY move per time slot */
+
 #define MM_PAGING
 //#define MM_FIXED_MEMSZ
 //#define VMDBG 1
 #define MMDBG 1
 #define IODUMP 1
 #define PAGETBL_DUMP 1
+//#define MM_STATS 1 /* print allocator counters when the simulation ends */
 
 #endif
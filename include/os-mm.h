@@ -1,10 +1,16 @@
 #ifndef OSMM_H
 #define OSMM_H
 
+#include <sys/types.h> /* pthread_mutex_t, sched.h here shadows the libc one */
 
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
 #define PAGING_MAX_SYMTBL_SZ 30
+#define VM_FREERG_NBINS 24 /* size class i keeps free regions of [2^i, 2^(i+1)) bytes */
+#define MM_TLB_SZ 16 /* entries of the per-mm software TLB, a power of two */
+#define MM_LTLB_SZ 4 /* entries for large pages, a power of two */
+#define VM_FREERG_HASHBITS 6 /* 64 buckets in the start/end lookup tables */
+#define FP_WORD_BITS 64 /* frames tracked by one word of the MEMPHY free bitmap */
 
 typedef char BYTE;
 typedef uint32_t addr_t;
@@ -23,6 +29,27 @@ struct vm_rg_struct {
    unsigned long rg_end;
 
    struct vm_rg_struct *rg_next;
+
+   /* Links used only while the region is free, see vm_freerg_bins */
+   struct vm_rg_struct *rg_prev;
+   struct vm_rg_struct *rg_hstart; /* next in the same by_start bucket */
+   struct vm_rg_struct *rg_hend;   /* next in the same by_end bucket */
+};
+
+/*
+ *  Free regions of a vm area, segregated by size class. Each bin is a
+ *  doubly linked list (rg_next/rg_prev), bitmap tells which bins are
+ *  not empty. by_start/by_end hash the region boundaries so that a
+ *  freed region finds its free neighbours without walking anything.
+ */
+struct vm_freerg_bins {
+   uint32_t bitmap;
+   struct vm_rg_struct *bin[VM_FREERG_NBINS];
+   struct vm_rg_struct *by_start[1 << VM_FREERG_HASHBITS];
+   struct vm_rg_struct *by_end[1 << VM_FREERG_HASHBITS];
+
+   unsigned long free_bytes;
+   int nfree;
 };
 
 /*
@@ -39,23 +66,110 @@ struct vm_area_struct {
  * unsigned long vm_limit = vm_end - vm_start
  */
    struct mm_struct *vm_mm;
-   struct vm_rg_struct *vm_freerg_list;
+   struct vm_freerg_bins vm_freerg;
    struct vm_area_struct *vm_next;
 };
 
+/*
+ *  Software TLB entry, direct mapped by pgn, pgn -1 when empty
+ */
+struct tlb_entry {
+   int pgn;
+   int fpn;
+};
+
+/*
+ *  Page replacement bookkeeping, see mm-pgrep.c. Lists are threaded
+ *  through node[], which is indexed by pgn and grown on demand, so
+ *  every list operation is O(1) and needs no allocation per page.
+ */
+#define PGREP_NLISTS 4
+
+struct pgrep_node {
+   int prev;
+   int next;
+   int list; /* -1 when the page is on no list */
+};
+
+struct pgrep_list {
+   int head; /* oldest / least recently used */
+   int tail; /* newest / most recently used */
+   int size;
+};
+
+struct pgrep_state {
+   struct pgrep_node *node;
+   int nnode;
+   struct pgrep_list list[PGREP_NLISTS];
+   int hand;  /* CLOCK hand */
+   int arc_p; /* ARC target size of T1 */
+};
+
+/*
+ *  Shared memory segment, see mm-shm.c. page[] holds a PTE per page of
+ *  the segment: its frame while attached mms map it, else its swap slot
+ */
+struct shm_seg {
+   int key;
+   int npages;
+   uint32_t *page;
+   int nattach; /* attached mms, under shm_lock, the segment is freed at 0 */
+
+   struct shm_seg *next;
+
+   /* Guards page[], taken after the mm_lock of an attacher */
+   pthread_mutex_t lock;
+};
+
+/*
+ *  Segment attached to an mm, on pages [pgn, pgn + npages)
+ */
+struct vm_shm_struct {
+   struct shm_seg *seg;
+   int pgn;
+   int npages;
+   struct vm_shm_struct *next;
+};
+
 /* 
  * Memory management struct
  */
 struct mm_struct {
-   uint32_t *pgd;
+   /* Page directory, see pte_ptr, NULL where no page table page is */
+   uint32_t **pgd;
+
+   /* Every page whose PTE was set once, see pte_map, walked on teardown */
+   int *mapped;
+   int nmapped;
+   int mapped_cap;
 
    struct vm_area_struct *mmap;
 
    /* Currently we support a fixed number of symbol */
    struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
 
-   /* list of free page */
-   struct pgn_t *fifo_pgn;
+   /* resident pages ordered for the page replacement policy */
+   struct pgrep_state pgrep;
+
+   /* Cached pgn -> fpn translations of pg_getpage */
+   struct tlb_entry tlb[MM_TLB_SZ];
+   /* Same for whole large pages, pgn >> PAGING_LPAGE_ORDER -> first fpn */
+   struct tlb_entry ltlb[MM_LTLB_SZ];
+
+   /* Shared memory segments attached */
+   struct vm_shm_struct *shm;
+
+   /* Swap read-ahead: page a sequential fault is expected on, window */
+   int ra_next;
+   int ra_win;
+
+   /* Resident pages, their peak and the most allowed, 0 for no limit */
+   int rss;
+   int rss_peak;
+   int rss_max;
+
+   /* Guards mmap, symrgtbl, pgd, tlb, pgrep and shm of this mm only */
+   pthread_mutex_t mm_lock;
 };
 
 /*
@@ -67,6 +181,11 @@ struct framephy_struct {
 
    /* Resereed for tracking allocated framed */
    struct mm_struct* owner;
+   int pgn; /* page of owner mapped on this frame, in memphy rmap */
+   int swpfpn; /* swap slot still holding a copy of the page, -1 if none */
+   int swptyp; /* swap device of that slot */
+   int refcnt; /* PTEs mapping the frame, more than one while COW or shm shared,
+                * the mappings after the first are chained on fp_next */
 };
 
 struct memphy_struct {
@@ -74,13 +193,29 @@ struct memphy_struct {
    BYTE *storage;
    int maxsz;
    
-   /* Sequential device fields */ 
+   /* Sequential device fields, the cursor only feeds the latency model
+    * so it is not locked, a racing update just blurs one seek distance */
    int rdmflg;
    int cursor;
-
-   /* Management structure */
-   struct framephy_struct *free_fp_list;
-   struct framephy_struct *used_fp_list;
+   int seek_rate; /* bytes the head crosses per time slot, 0 free seeks */
+
+   /* Management structure: frames from fp_hwm up were never handed out.
+    * Below it a set bit of fp_bitmap is a recycled free frame, a set bit
+    * of fp_summary is a fp_bitmap word with at least one of them */
+   uint64_t *fp_bitmap;
+   uint64_t *fp_summary;
+   int numfp;
+   int nfree;
+   int nfree_low; /* fewest free frames ever, the peak usage */
+   int fp_hwm;
+   int fp_hint; /* lowest fp_summary word that may be non zero */
+
+   /* Reverse map, the owner mm and pgn of every frame, NULL owner if none */
+   struct framephy_struct *rmap;
+   int rmap_hand; /* global replacement clock hand */
+
+   /* Guards the free bitmap and rmap, the frames are shared by all mm */
+   pthread_mutex_t fp_lock;
 };
 
 #endif
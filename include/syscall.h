@@ -35,6 +35,6 @@
  extern const char* sys_call_table[];
  extern const int syscall_table_size;
  int syscall(struct pcb_t*, uint32_t, struct sc_regs*);
- int libsyscall(struct pcb_t*, uint32_t, uint32_t, uint32_t, uint32_t);
+ int libsyscall(struct pcb_t*, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
  int __sys_ni_syscall(struct pcb_t*, struct sc_regs*);
  
\ No newline at end of file
@@ -0,0 +1,57 @@
+#!/bin/bash
+# Page faults and memory-op throughput of a workload with multi-KB regions
+# across page sizes, with and without large pages
+# Usage: scripts/bench-pagesz.sh [page sizes...]   (default: 256 1024 4096 16384 65536)
+
+RED='\e[31m'
+GREEN='\e[32m'
+NC='\e[0m'
+
+cd "$(dirname "$0")/.." || exit 1
+
+SIZES=${@:-256 1024 4096 16384 65536}
+LOOPS=3
+SEED=7
+MIX="alloc:2,free:1,read:3,write:3,memset:2,memcpy:1"
+name="bench_pgsz"
+set -o pipefail
+
+# The counters read below are only printed with MM_STATS
+echo -e "[BUILDING] Starting make all with MM_STATS..."
+if ! make -B all DEBUG="-g -DMM_STATS" > /dev/null 2>&1; then
+    make -B all DEBUG="-g -DMM_STATS"
+    echo -e "${RED}Build failed.${NC}"
+    exit 1
+fi
+
+./gen -n 4 -c 2 -t 4 -a fixed -r 1 -i "$MIX" -l 30 -L $LOOPS -z 2048:16384 \
+      -x random -m 2097152:16777216 -s $SEED $name > /dev/null || exit 1
+ops=$(cat input/proc/${name}_* | grep -cE '^(alloc|free|read|write|memset|memcpy)')
+ops=$((ops * LOOPS))
+
+printf "%8s %6s %10s %10s %8s %10s %8s %10s\n" \
+       "pagesz" "large" "accesses" "faults" "tlb" "pgt pages" "ms" "ops/s"
+for sz in $SIZES; do
+    for large in off on; do
+        opts="-d -p $sz"
+        [ $large == on ] && opts="$opts -l"
+
+        # Only the statistics are kept, the memory dumps are large
+        start=$(date +%s%N)
+        if ! out=$(./os $opts $name 2>&1 | grep -E '^(paging|tlb|page tables):'); then
+            echo -e "${RED}./os $opts $name failed${NC}"
+            continue
+        fi
+        ms=$(( ($(date +%s%N) - start) / 1000000 ))
+
+        acc=$(echo "$out" | sed -n 's/^paging: .*, \([0-9]*\) accesses, .*/\1/p')
+        flt=$(echo "$out" | sed -n 's/^paging: .* accesses, \([0-9]*\) faults.*/\1/p')
+        tlb=$(echo "$out" | sed -n 's/^tlb: .*hit rate \([0-9]*%\).*/\1/p')
+        pgt=$(echo "$out" | sed -n 's/^page tables: \([0-9]*\) .*/\1/p')
+
+        printf "%8d %6s %10s %10s %8s %10s %8d %10d\n" $sz $large \
+               "$acc" "$flt" "$tlb" "$pgt" $ms $(( ops * 1000 / (ms > 0 ? ms : 1) ))
+    done
+done
+rm -f input/$name input/proc/${name}_*
+echo -e "${GREEN}Done.${NC}"
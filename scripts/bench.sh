@@ -0,0 +1,44 @@
+#!/bin/bash
+# Memory-op throughput of allocation-heavy workloads on 1..64 CPUs
+# Usage: scripts/bench.sh [cpu counts...]   (default: 1 2 4 8 16 32 64)
+
+RED='\e[31m'
+GREEN='\e[32m'
+NC='\e[0m'
+
+cd "$(dirname "$0")/.." || exit 1
+
+CPUS=${@:-1 2 4 8 16 32 64}
+LOOPS=20
+SEED=7
+MIX="alloc:4,free:3,read:2,write:2,memset:1,memcpy:1,calc:1"
+
+echo -e "[BUILDING] Starting make all..."
+if ! make all > /dev/null 2>&1; then
+    make all
+    echo -e "${RED}Build failed.${NC}"
+    exit 1
+fi
+
+printf "%6s %10s %10s %12s\n" "CPUs" "mem ops" "ms" "ops/s"
+for n in $CPUS; do
+    name="bench_$n"
+
+    # One process per CPU, each on its own priority so no ready queue overflows
+    prios=$(seq -s, 0 $((n - 1)) | sed 's/\([0-9]*\)/\1:1/g')
+    ./gen -n $n -c $n -t 4 -a fixed -r 0 -p "$prios" -i "$MIX" \
+          -l 40 -L $LOOPS -x random -s $SEED $name > /dev/null || exit 1
+
+    ops=$(cat input/proc/${name}_* | grep -cE '^(alloc|free|read|write|memset|memcpy)')
+    ops=$((ops * LOOPS))
+
+    start=$(date +%s%N)
+    if ! ./os $name > /dev/null 2>&1; then
+        echo -e "${RED}./os $name failed${NC}"
+    fi
+    ms=$(( ($(date +%s%N) - start) / 1000000 ))
+
+    printf "%6d %10d %10d %12d\n" $n $ops $ms $(( ops * 1000 / (ms > 0 ? ms : 1) ))
+    rm -f input/$name input/proc/${name}_*
+done
+echo -e "${GREEN}Done.${NC}"
@@ -19,14 +19,14 @@ int alloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index)
 	}
 	else
 	{
-		proc->regs[reg_index] = addr;
+		proc->cold->regs[reg_index] = addr;
 		return 0;
 	}
 }
 
 int free_data(struct pcb_t *proc, uint32_t reg_index)
 {
-	return free_mem(proc->regs[reg_index], proc);
+	return free_mem(proc->cold->regs[reg_index], proc);
 }
 
 int read(
@@ -37,9 +37,9 @@ int read(
 { // Index of destination register
 
 	BYTE data;
-	if (read_mem(proc->regs[source] + offset, proc, &data))
+	if (read_mem(proc->cold->regs[source] + offset, proc, &data))
 	{
-		proc->regs[destination] = data;
+		proc->cold->regs[destination] = data;
 		return 0;
 	}
 	else
@@ -55,11 +55,78 @@ int write(
 	uint32_t offset)
 { // Destination address =
 	// [destination] + [offset]
-	return write_mem(proc->regs[destination] + offset, proc, data);
+	return write_mem(proc->cold->regs[destination] + offset, proc, data);
+}
+
+int memset_data(
+	struct pcb_t *proc,	// Process executing the instruction
+	uint32_t destination, // Index of destination register
+	uint32_t offset,	// Destination address = [destination] + [offset]
+	uint32_t len,		// Number of bytes
+	BYTE value)
+{
+	uint32_t i;
+	for (i = 0; i < len; i++)
+		if (write_mem(proc->cold->regs[destination] + offset + i, proc, value))
+			return 1;
+	return 0;
+}
+
+int memcpy_data(
+	struct pcb_t *proc,	// Process executing the instruction
+	uint32_t destination, // Index of destination register
+	uint32_t dstoff,	// Destination address = [destination] + [dstoff]
+	uint32_t source,	// Index of source register
+	uint32_t srcoff,	// Source address = [source] + [srcoff]
+	uint32_t len)		// Number of bytes
+{
+	BYTE data;
+	uint32_t i;
+	for (i = 0; i < len; i++)
+		if (read_mem(proc->cold->regs[source] + srcoff + i, proc, &data) ||
+		    write_mem(proc->cold->regs[destination] + dstoff + i, proc, data))
+			return 1;
+	return 0;
+}
+
+/* Number of time slots a bulk memory instruction is charged for */
+static uint32_t bulkmem_slots(uint32_t len)
+{
+	uint32_t slots = DIV_ROUND_UP(len, BULKMEM_SLOT_BYTES);
+	return (slots > 0) ? slots : 1;
+}
+
+/* Step over loop control so that pc rests on a real instruction or on
+ * the end of the code. REPEAT/END never consume a time slot of their own */
+static void resolve_loops(struct pcb_t *proc)
+{
+	struct inst_t *ins;
+
+	while (proc->pc < proc->code->size)
+	{
+		ins = &proc->code->text[proc->pc];
+		if (ins->opcode == REPEAT)
+		{
+			proc->cold->loop_cnt[ins->arg_2] = ins->arg_0;
+			/* An empty count skips the body altogether */
+			proc->pc = (ins->arg_0 > 0) ? proc->pc + 1 : ins->arg_1 + 1;
+		}
+		else if (ins->opcode == END)
+		{
+			if (--proc->cold->loop_cnt[ins->arg_1] > 0)
+				proc->pc = ins->arg_0 + 1;
+			else
+				proc->pc++;
+		}
+		else
+			break;
+	}
 }
 
 int run(struct pcb_t *proc)
 {
+	resolve_loops(proc);
+
 	/* Check if Program Counter point to the proper instruction */
 	if (proc->pc >= proc->code->size)
 	{
@@ -69,6 +136,9 @@ int run(struct pcb_t *proc)
 	struct inst_t ins = proc->code->text[proc->pc];
 	proc->pc++;
 	int stat = 1;
+#ifdef MM_PAGING
+	uint64_t word;
+#endif
 switch (ins.opcode)
 	{
 	case CALC:
@@ -76,7 +146,7 @@ switch (ins.opcode)
 		break;
 	case ALLOC:
 #ifdef MM_PAGING
-		stat = liballoc(proc, ins.arg_0, ins.arg_1);
+		stat = liballoc(proc, ins.arg_0, ins.arg_1, ins.arg_2);
 #else
 		stat = alloc(proc, ins.arg_0, ins.arg_1);
 #endif
@@ -103,10 +173,59 @@ switch (ins.opcode)
 #endif
 		break;
 	case SYSCALL:
-		stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
+		stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3, ins.arg_4);
+		break;
+	case READW:
+#ifdef MM_PAGING
+		stat = libreadw(proc, ins.arg_0, ins.arg_1, ins.arg_2, &word);
+#else
+		stat = 1; /* Legacy memory only moves single bytes */
+#endif
+		break;
+	case WRITEW:
+#ifdef MM_PAGING
+		word = ((uint64_t)ins.arg_4 << 32) | ins.arg_0;
+		stat = libwritew(proc, word, ins.arg_1, ins.arg_2, ins.arg_3);
+#else
+		stat = 1;
+#endif
+		break;
+	case READV:
+#ifdef MM_PAGING
+		stat = libreadv(proc, ins.arg_0, ins.arg_1, ins.arg_2, proc->cold->vreg);
+#else
+		stat = 1;
+#endif
+		break;
+	case WRITEV:
+#ifdef MM_PAGING
+		stat = libwritev(proc, proc->cold->vreg, ins.arg_0, ins.arg_1, ins.arg_2);
+#else
+		stat = 1;
+#endif
+		break;
+	case MEMSET:
+#ifdef MM_PAGING
+		stat = libmemset(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
+#else
+		stat = memset_data(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
+#endif
+		proc->stall += bulkmem_slots(ins.arg_2) - 1;
+		break;
+	case MEMCPY:
+#ifdef MM_PAGING
+		stat = libmemcpy(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3, ins.arg_4);
+#else
+		stat = memcpy_data(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3, ins.arg_4);
+#endif
+		proc->stall += bulkmem_slots(ins.arg_4) - 1;
 		break;
 	default:
 		stat = 1;
 	}
+
+	/* Leave pc on the next real instruction so that cpu_routine sees
+	 * the process finish right after its last one */
+	resolve_loops(proc);
 	return stat;
 }
\ No newline at end of file
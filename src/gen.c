@@ -0,0 +1,437 @@
+
+/*
+ * Synthetic workload generator
+ *
+ * Emits an os config file input/<name> and its process programs
+ * input/proc/<name>_<i> from a handful of parameters. The same seed always
+ * produces the same files, whatever the host libc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+
+#define GEN_MAX_RG 30		/* PAGING_MAX_SYMTBL_SZ */
+#define GEN_MAX_MIX 140		/* MAX_PRIO, a priority mix may list them all */
+#define GEN_NAME_SZ 64
+
+enum gen_arrival { ARRIVAL_FIXED, ARRIVAL_POISSON, ARRIVAL_BURSTY };
+enum gen_access { ACCESS_SEQ, ACCESS_RANDOM, ACCESS_ZIPF };
+
+/* A weighted choice list, parsed from "key:weight,key:weight,..." */
+struct gen_mix {
+	char key[GEN_MAX_MIX][16];
+	unsigned long val[GEN_MAX_MIX];
+	double weight[GEN_MAX_MIX];
+	int size;
+};
+
+static struct {
+	int nproc;
+	int ncpu;
+	int slice;
+	uint64_t seed;
+	enum gen_arrival arrival;
+	double rate;		/* mean slots between arrivals (bursts) */
+	int burst;		/* processes per burst */
+	struct gen_mix prio;
+	struct gen_mix ins;
+	int len;		/* instructions per loop body */
+	int loops;		/* repeat count of the body, 1 = no loop */
+	int alloc_min, alloc_max;
+	enum gen_access access;
+	double zipf_s;
+	int ramsz, swpsz;
+} cfg = {
+	.nproc = 8,
+	.ncpu = 2,
+	.slice = 2,
+	.seed = 1,
+	.arrival = ARRIVAL_FIXED,
+	.rate = 1.0,
+	.burst = 4,
+	.len = 20,
+	.loops = 1,
+	.alloc_min = 64,
+	.alloc_max = 1024,
+	.access = ACCESS_SEQ,
+	.zipf_s = 1.0,
+	.ramsz = 1048576,
+	.swpsz = 16777216,
+};
+
+/* splitmix64, so the output does not depend on rand() of the host */
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+	uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Uniform in [0, 1) */
+static double rng_unit(void) {
+	return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Uniform in [lo, hi] */
+static int rng_range(int lo, int hi) {
+	return lo + (int)(rng_next() % (uint64_t)(hi - lo + 1));
+}
+
+static double rng_exp(double mean) {
+	return -log(1.0 - rng_unit()) * mean;
+}
+
+static int mix_pick(struct gen_mix * mix) {
+	double total = 0, x;
+	int i;
+	for (i = 0; i < mix->size; i++)
+		total += mix->weight[i];
+	x = rng_unit() * total;
+	for (i = 0; i < mix->size - 1; i++) {
+		if (x < mix->weight[i])
+			return i;
+		x -= mix->weight[i];
+	}
+	return mix->size - 1;
+}
+
+static int mix_parse(struct gen_mix * mix, const char * spec) {
+	char buf[256];
+	char * tok, * save;
+
+	snprintf(buf, sizeof(buf), "%s", spec);
+	mix->size = 0;
+	for (tok = strtok_r(buf, ",", &save); tok != NULL;
+	     tok = strtok_r(NULL, ",", &save)) {
+		char * colon = strchr(tok, ':');
+		if (mix->size == GEN_MAX_MIX)
+			return -1;
+		if (colon != NULL)
+			*colon = '\0';
+		snprintf(mix->key[mix->size], sizeof(mix->key[0]), "%s", tok);
+		mix->val[mix->size] = strtoul(tok, NULL, 10);
+		mix->weight[mix->size] = colon ? atof(colon + 1) : 1.0;
+		if (mix->weight[mix->size] < 0)
+			return -1;
+		mix->size++;
+	}
+	return (mix->size > 0) ? 0 : -1;
+}
+
+/* Zipf over [0, n) with exponent s, by inversion of the cdf */
+static int rng_zipf(int n, double s) {
+	double norm = 0, x;
+	int k;
+	for (k = 1; k <= n; k++)
+		norm += 1.0 / pow(k, s);
+	x = rng_unit() * norm;
+	for (k = 1; k < n; k++) {
+		x -= 1.0 / pow(k, s);
+		if (x < 0)
+			break;
+	}
+	return k - 1;
+}
+
+/* Region state of the program being generated */
+struct gen_prog {
+	int size[GEN_MAX_RG];	/* 0 when the region is not allocated */
+	int cursor[GEN_MAX_RG];	/* sequential access position */
+	int seq_rg;		/* region walked by the sequential pattern */
+};
+
+static int pick_allocated(struct gen_prog * prog) {
+	int live[GEN_MAX_RG], n = 0, rg;
+	for (rg = 0; rg < GEN_MAX_RG; rg++)
+		if (prog->size[rg] > 0)
+			live[n++] = rg;
+	if (n == 0)
+		return -1;
+	if (cfg.access == ACCESS_ZIPF)
+		return live[rng_zipf(n, cfg.zipf_s)];
+	if (cfg.access == ACCESS_SEQ) {
+		/* Stay on one region until it is freed */
+		if (prog->seq_rg < 0 || prog->size[prog->seq_rg] == 0)
+			prog->seq_rg = live[0];
+		return prog->seq_rg;
+	}
+	return live[rng_range(0, n - 1)];
+}
+
+static int pick_offset(struct gen_prog * prog, int rg, int len) {
+	int span = prog->size[rg] - len + 1;
+	int off;
+	if (span <= 0)
+		return -1;
+	switch (cfg.access) {
+	case ACCESS_SEQ:
+		off = prog->cursor[rg];
+		if (off >= span)
+			off = 0;
+		prog->cursor[rg] = off + len;
+		return off;
+	case ACCESS_ZIPF:
+		/* Hot bytes at the head of the region */
+		return rng_zipf(span < 1024 ? span : 1024, cfg.zipf_s);
+	default:
+		return rng_range(0, span - 1);
+	}
+}
+
+/* Emit one instruction of kind [op], degrading to calc when the program
+ * state does not allow it (nothing allocated, symbol table full, ...) */
+static void emit_ins(FILE * f, const char * op, struct gen_prog * prog) {
+	int rg, rg2, off, off2, len;
+
+	if (!strcmp(op, "alloc")) {
+		for (rg = 0; rg < GEN_MAX_RG && prog->size[rg] > 0; rg++)
+			;
+		if (rg < GEN_MAX_RG) {
+			prog->size[rg] = rng_range(cfg.alloc_min, cfg.alloc_max);
+			prog->cursor[rg] = 0;
+			fprintf(f, "alloc %d %d\n", prog->size[rg], rg);
+			return;
+		}
+	} else if (!strcmp(op, "free")) {
+		if ((rg = pick_allocated(prog)) >= 0) {
+			prog->size[rg] = 0;
+			fprintf(f, "free %d\n", rg);
+			return;
+		}
+	} else if (!strcmp(op, "read") || !strcmp(op, "write")) {
+		if ((rg = pick_allocated(prog)) >= 0 &&
+		    (off = pick_offset(prog, rg, 1)) >= 0) {
+			if (op[0] == 'r')
+				fprintf(f, "read %d %d 0\n", rg, off);
+			else
+				fprintf(f, "write %d %d %d\n",
+					rng_range(1, 127), rg, off);
+			return;
+		}
+	} else if (!strcmp(op, "memset")) {
+		if ((rg = pick_allocated(prog)) >= 0) {
+			len = rng_range(1, prog->size[rg]);
+			if ((off = pick_offset(prog, rg, len)) >= 0) {
+				fprintf(f, "memset %d %d %d %d\n",
+					rg, off, len, rng_range(1, 127));
+				return;
+			}
+		}
+	} else if (!strcmp(op, "memcpy")) {
+		if ((rg = pick_allocated(prog)) >= 0 &&
+		    (rg2 = pick_allocated(prog)) >= 0) {
+			len = rng_range(1, prog->size[rg] < prog->size[rg2] ?
+				prog->size[rg] : prog->size[rg2]);
+			off = pick_offset(prog, rg, len);
+			off2 = pick_offset(prog, rg2, len);
+			if (off >= 0 && off2 >= 0) {
+				fprintf(f, "memcpy %d %d %d %d %d\n",
+					rg, off, rg2, off2, len);
+				return;
+			}
+		}
+	}
+	fprintf(f, "calc\n");
+}
+
+static int gen_prog(const char * path, unsigned long prio) {
+	struct gen_prog prog;
+	FILE * f, * body;
+	int i, c, size;
+
+	if ((f = fopen(path, "w")) == NULL) {
+		printf("Cannot create process description at '%s'\n", path);
+		return -1;
+	}
+	memset(&prog, 0, sizeof(prog));
+	prog.seq_rg = -1;
+
+	/* The header needs the final count, so emit the body first */
+	if ((body = tmpfile()) == NULL) {
+		fclose(f);
+		return -1;
+	}
+	for (i = 0; i < cfg.len; i++)
+		emit_ins(body, cfg.ins.key[mix_pick(&cfg.ins)], &prog);
+
+	size = cfg.len;
+	if (cfg.loops > 1)
+		for (i = 0; i < GEN_MAX_RG; i++)
+			size += (prog.size[i] > 0);
+	size += (cfg.loops > 1) ? 2 : 0;
+
+	fprintf(f, "%lu %d\n", prio, size);
+	if (cfg.loops > 1)
+		fprintf(f, "repeat %d\n", cfg.loops);
+	rewind(body);
+	while ((c = fgetc(body)) != EOF)
+		fputc(c, f);
+	fclose(body);
+	if (cfg.loops > 1) {
+		/* Release what the body allocated so every iteration starts
+		 * from the same state */
+		for (i = 0; i < GEN_MAX_RG; i++)
+			if (prog.size[i] > 0)
+				fprintf(f, "free %d\n", i);
+		fprintf(f, "end\n");
+	}
+	fclose(f);
+	return 0;
+}
+
+static int gen_all(const char * name) {
+	char path[128], proc[GEN_NAME_SZ + 16];
+	unsigned long start = 0;
+	double clock = 0;
+	FILE * f;
+	int i;
+
+	snprintf(path, sizeof(path), "input/%s", name);
+	if ((f = fopen(path, "w")) == NULL) {
+		printf("Cannot create configure file at %s\n", path);
+		return -1;
+	}
+	fprintf(f, "%d %d %d\n", cfg.slice, cfg.ncpu, cfg.nproc);
+	fprintf(f, "%d %d 0 0 0\n", cfg.ramsz, cfg.swpsz);
+
+	for (i = 0; i < cfg.nproc; i++) {
+		unsigned long prio = cfg.prio.val[mix_pick(&cfg.prio)];
+
+		switch (cfg.arrival) {
+		case ARRIVAL_FIXED:
+			start = (unsigned long)(i * cfg.rate);
+			break;
+		case ARRIVAL_POISSON:
+			if (i > 0)
+				clock += rng_exp(cfg.rate);
+			start = (unsigned long)clock;
+			break;
+		case ARRIVAL_BURSTY:
+			if (i > 0 && i % cfg.burst == 0)
+				clock += rng_exp(cfg.rate * cfg.burst);
+			start = (unsigned long)clock;
+			break;
+		}
+
+		snprintf(proc, sizeof(proc), "%s_%d", name, i);
+		fprintf(f, "%lu %s %lu\n", start, proc, prio);
+
+		snprintf(path, sizeof(path), "input/proc/%s", proc);
+		if (gen_prog(path, prio) != 0) {
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static void usage(void) {
+	printf("Usage: gen [options] NAME\n"
+	       "Writes input/NAME and input/proc/NAME_<i>\n"
+	       "  -n N          number of processes (8)\n"
+	       "  -c N          number of CPUs (2)\n"
+	       "  -t N          time slice (2)\n"
+	       "  -s SEED       random seed (1)\n"
+	       "  -a KIND       arrival: fixed, poisson, bursty (fixed)\n"
+	       "  -r SLOTS      mean slots between arrivals or bursts (1)\n"
+	       "  -b N          processes per burst (4)\n"
+	       "  -p MIX        priority mix, prio:weight,... (0:1)\n"
+	       "  -i MIX        instruction mix, op:weight,... over calc alloc\n"
+	       "                free read write memset memcpy\n"
+	       "  -l N          instructions per program (20)\n"
+	       "  -L N          repeat the program body N times (1)\n"
+	       "  -z MIN:MAX    allocation size range (64:1024)\n"
+	       "  -x KIND       access: seq, random, zipf (seq)\n"
+	       "  -Z S          zipf exponent (1.0)\n"
+	       "  -m RAM:SWAP   memory sizes (1048576:16777216)\n");
+}
+
+int main(int argc, char * argv[]) {
+	int opt;
+
+	mix_parse(&cfg.prio, "0:1");
+	mix_parse(&cfg.ins, "calc:4,alloc:1,free:1,read:2,write:2");
+
+	while ((opt = getopt(argc, argv, "n:c:t:s:a:r:b:p:i:l:L:z:x:Z:m:h")) != -1) {
+		switch (opt) {
+		case 'n': cfg.nproc = atoi(optarg); break;
+		case 'c': cfg.ncpu = atoi(optarg); break;
+		case 't': cfg.slice = atoi(optarg); break;
+		case 's': cfg.seed = strtoull(optarg, NULL, 0); break;
+		case 'a':
+			if (!strcmp(optarg, "fixed"))
+				cfg.arrival = ARRIVAL_FIXED;
+			else if (!strcmp(optarg, "poisson"))
+				cfg.arrival = ARRIVAL_POISSON;
+			else if (!strcmp(optarg, "bursty"))
+				cfg.arrival = ARRIVAL_BURSTY;
+			else {
+				usage();
+				return 1;
+			}
+			break;
+		case 'r': cfg.rate = atof(optarg); break;
+		case 'b': cfg.burst = atoi(optarg); break;
+		case 'p':
+			if (mix_parse(&cfg.prio, optarg) != 0) {
+				usage();
+				return 1;
+			}
+			break;
+		case 'i':
+			if (mix_parse(&cfg.ins, optarg) != 0) {
+				usage();
+				return 1;
+			}
+			break;
+		case 'l': cfg.len = atoi(optarg); break;
+		case 'L': cfg.loops = atoi(optarg); break;
+		case 'z':
+			if (sscanf(optarg, "%d:%d", &cfg.alloc_min, &cfg.alloc_max) != 2) {
+				usage();
+				return 1;
+			}
+			break;
+		case 'x':
+			if (!strcmp(optarg, "seq"))
+				cfg.access = ACCESS_SEQ;
+			else if (!strcmp(optarg, "random"))
+				cfg.access = ACCESS_RANDOM;
+			else if (!strcmp(optarg, "zipf"))
+				cfg.access = ACCESS_ZIPF;
+			else {
+				usage();
+				return 1;
+			}
+			break;
+		case 'Z': cfg.zipf_s = atof(optarg); break;
+		case 'm':
+			if (sscanf(optarg, "%d:%d", &cfg.ramsz, &cfg.swpsz) != 2) {
+				usage();
+				return 1;
+			}
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1 || strlen(argv[optind]) > GEN_NAME_SZ ||
+	    cfg.nproc <= 0 || cfg.ncpu <= 0 || cfg.slice <= 0 ||
+	    cfg.len <= 0 || cfg.loops <= 0 || cfg.burst <= 0 || cfg.rate < 0 ||
+	    cfg.alloc_min <= 0 || cfg.alloc_max < cfg.alloc_min) {
+		usage();
+		return 1;
+	}
+
+	rng_state = cfg.seed;
+	return gen_all(argv[optind]) ? 1 : 0;
+}
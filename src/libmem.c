@@ -21,75 +21,17 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
-
-static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
+#include <inttypes.h>
 
 /*enlist_vm_freerg_list - add new rg to freerg_list
 *@mm: memory region
 *@rg_elmt: new region
 *
+*The region is merged with the free regions right before and after it
 */
 int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct *rg_elmt)
 {
-  if (rg_elmt->rg_start >= rg_elmt->rg_end)
-    return -1;
-
-  struct vm_rg_struct **rg_node = &mm->mmap->vm_freerg_list;
-  struct vm_rg_struct *prev = NULL;
-
-  // Insert the new region into the list in sorted order
-  while (*rg_node != NULL && (*rg_node)->rg_end < rg_elmt->rg_end)
-  {
-    prev = *rg_node;
-    rg_node = &(*rg_node)->rg_next;
-  }
-
-  // Insert the new region
-  rg_elmt->rg_next = *rg_node;
-  if (prev == NULL)
-  {
-    mm->mmap->vm_freerg_list = rg_elmt; // Insert at the head
-  }
-  else
-  {
-    prev->rg_next = rg_elmt; // Insert in the middle or end
-  }
-
-  // Merge all overlapping or adjacent regions
-  struct vm_rg_struct *curr = mm->mmap->vm_freerg_list;
-  while (curr)
-  {
-    struct vm_rg_struct *prev = curr;
-    struct vm_rg_struct *next = curr->rg_next;
-    while (next)
-    {
-      if (curr->rg_end - curr->rg_start < 256)
-      {
-        prev = next;
-        next = next->rg_next;
-        continue; // No overlap, move to the next region
-      }
-      // If curr and next overlap or are adjacent, merge them
-      if (!(curr->rg_end < next->rg_start || curr->rg_start > next->rg_end))
-      {
-        if (next->rg_start < curr->rg_start)
-          curr->rg_start = next->rg_start;
-        if (next->rg_end > curr->rg_end)
-          curr->rg_end = next->rg_end;
-        // Remove next from list
-        prev->rg_next = next->rg_next;
-        free(next);
-        next = prev->rg_next;
-      }
-      else
-      {
-        prev = next;
-        next = next->rg_next;
-      }
-    }
-    curr = curr->rg_next;
-  }
-  return 0;
+  return vm_freerg_insert(&mm->mmap->vm_freerg, rg_elmt);
 }
 
 /*get_symrg_byid - get mem region by region ID
@@ -116,79 +58,50 @@ struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid)
 int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr)
 {
   /*Allocate at the toproof */
-  pthread_mutex_lock(&mmvm_lock);
+  pthread_mutex_lock(&caller->mm->mm_lock);
+#ifdef MM_STATS
+  uint64_t t0 = mm_stats_now();
+#endif
   struct vm_rg_struct rgnode;
-
-  /* Calculate available space in existing free regions */
-  int total_free_size = 0;
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
-  struct vm_rg_struct *rgit = cur_vma->vm_freerg_list;
+  int val = 0;
 
-  while (rgit != NULL)
+  if (cur_vma == NULL || size <= 0 || rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
   {
-    if (rgit->rg_end - rgit->rg_start >= 256)
-    {
-      total_free_size += (rgit->rg_end - rgit->rg_start);
-    }
-    rgit = rgit->rg_next;
+    pthread_mutex_unlock(&caller->mm->mm_lock);
+    return -1;
   }
 
-  if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0)
-  {
-    caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
-    caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_start + size;
-
-    *alloc_addr = rgnode.rg_start;
-
-    pthread_mutex_unlock(&mmvm_lock);
-    return 0;
-  }
+  MM_STAT_ADD(frag_permille, vm_freerg_frag(&cur_vma->vm_freerg));
+  MM_STAT_INC(frag_samples);
 
-  /* Only increase by the amount actually needed */
-  int inc_sz = size - total_free_size;
-  if (inc_sz <= 0)
-  {
-    inc_sz = PAGING_PAGE_ALIGNSZ(256); // Minimum page size if something went wrong
-  }
-  else
+  if (get_free_vmrg_area(caller, vmaid, size, &rgnode) != 0)
   {
-    inc_sz = PAGING_PAGE_ALIGNSZ(inc_sz);
-  }
+    /* Only grow by what the free region at the break is missing */
+    int inc_sz = PAGING_PAGE_ALIGNSZ(size - vm_freerg_tail(&cur_vma->vm_freerg, cur_vma->sbrk));
 
-  /* Retrieve old_sbrk */
-  int old_sbrk = cur_vma->sbrk;
+    /* Increase the limit using system call */
+    inc_vma_limit(caller, vmaid, inc_sz);
+    MM_STAT_INC(alloc_brk_cnt);
 
-  /* Increase the limit using system call */
-  inc_vma_limit(caller, vmaid, inc_sz);
+    /*Successful increase limit */
+    if (get_free_vmrg_area(caller, vmaid, size, &rgnode) != 0)
+      val = -1;
+  }
 
-  /*Successful increase limit */
-  if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0)
+  if (val == 0)
   {
     caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
     caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_start + size;
-    *alloc_addr = rgnode.rg_start;
-
-    pthread_mutex_unlock(&mmvm_lock);
-    return 0;
-  }
-
-  // Fallback: if still not found, allocate at the old sbrk (should not happen)
-  caller->mm->symrgtbl[rgid].rg_start = old_sbrk;
-  caller->mm->symrgtbl[rgid].rg_end = old_sbrk + size;
-  *alloc_addr = old_sbrk;
 
-  /* Handle remaining free space */
-  struct vm_area_struct *remain_rg = get_vma_by_num(caller->mm, vmaid);
-  if (old_sbrk + size < remain_rg->sbrk)
-  {
-    struct vm_rg_struct *rg_free = malloc(sizeof(struct vm_rg_struct));
-    rg_free->rg_start = old_sbrk + size;
-    rg_free->rg_end = remain_rg->sbrk;
-    enlist_vm_freerg_list(caller->mm, rg_free);
+    *alloc_addr = rgnode.rg_start;
   }
 
-  pthread_mutex_unlock(&mmvm_lock);
-  return 0;
+#ifdef MM_STATS
+  mm_stats_alloc_done(mm_stats_now() - t0);
+#endif
+  pthread_mutex_unlock(&caller->mm->mm_lock);
+  return val;
 }
 
 /*__free - remove a region memory
@@ -200,11 +113,11 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
 */
 int __free(struct pcb_t *caller, int vmaid, int rgid)
 {
-  pthread_mutex_lock(&mmvm_lock);
+  pthread_mutex_lock(&caller->mm->mm_lock);
 
   if (rgid < 0 || rgid > PAGING_MAX_SYMTBL_SZ)
   {
-    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_unlock(&caller->mm->mm_lock);
     return -1;
   }
 
@@ -213,9 +126,12 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
 
   if (rgnode->rg_start == 0 && rgnode->rg_end == 0)
   {
-    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_unlock(&caller->mm->mm_lock);
     return -1;
   }
+  /* A shared memory region is detached, its pages are then plain ones */
+  shm_detach(caller, rgnode->rg_start);
+
   struct vm_rg_struct *freerg_node = malloc(sizeof(struct vm_rg_struct));
   freerg_node->rg_start = rgnode->rg_start;
   freerg_node->rg_end = rgnode->rg_end;
@@ -226,8 +142,9 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
 
   /*enlist the obsoleted memory region */
   enlist_vm_freerg_list(caller->mm, freerg_node);
+  MM_STAT_INC(free_cnt);
 
-  pthread_mutex_unlock(&mmvm_lock);
+  pthread_mutex_unlock(&caller->mm->mm_lock);
   return 0;
 }
 
@@ -236,7 +153,7 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
 *@size: allocated size
 *@reg_index: memory region ID (used to identify variable in symbole table)
 */
-int liballoc(struct pcb_t *proc, uint32_t size, uint32_t reg_index)
+int liballoc(struct pcb_t *proc, uint32_t size, uint32_t reg_index, uint32_t populate)
 {
   /* TODO Implement allocation on vm area 0 */
   int addr;
@@ -245,6 +162,10 @@ int liballoc(struct pcb_t *proc, uint32_t size, uint32_t reg_index)
   {
     return -1;
   }
+  if (populate && __populate(proc, addr, size) != 0)
+  {
+    return -1;
+  }
 #ifdef IODUMP
   printf("===== PHYSICAL MEMORY AFTER ALLOCATION =====\n");
   printf("PID=%d - Region=%d - Address=%08x - Size=%d byte\n", proc->pid, reg_index, addr, size);
@@ -282,236 +203,1155 @@ int libfree(struct pcb_t *proc, uint32_t reg_index)
   return val;
 }
 
-/*pg_getpage - get the page in ram
-*@mm: memory region
-*@pagenum: PGN
-*@framenum: return FPN
+/*pg_unmap_sharers - swap out the other mappings of a COW shared victim
+*@mm: faulting mm, its mm_lock is held
+*@vicmm: mm the victim was taken from, locked as well
+*@fpn: shared frame
+*@shm: frame of a shared memory segment, its lock is held
 *@caller: caller
 *
+* The frame only comes free once no PTE maps it, so every mapping left
+* gets a slot of its own, a shm mapping is simply dropped and faults in
+* through its segment again. A sharer is only taken with trylock, no
+* lock is waited for while the faulting mm and a segment lock are held:
+* one that is busy keeps the frame and the caller moves on to its next
+* victim. Return @fpn once it is free, -1 otherwise
 */
-int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+static int pg_unmap_sharers(struct mm_struct *mm, struct mm_struct *vicmm, int fpn, int shm,
+                            struct pcb_t *caller)
 {
-  printf("pg_getpage: pgn=%d\n", pgn);
-  uint32_t pte = mm->pgd[pgn];
-
-  if (!PAGING_PAGE_PRESENT(pte))
-  { /* Page is not online, make it actively living */
-    int vicpgn, swpfpn;
-    int vicfpn;
-    uint32_t vicpte;
+  struct mm_struct *owner;
+  int idx = 0, left = 1;
+  int pgn, swptyp, swpfpn, locked;
+  uint32_t pte, *ptep;
 
-    int tgtfpn = PAGING_PTE_SWP(pte); // the target frame storing our variable
+  while (left > 0 && (owner = MEMPHY_get_sharer(caller->mram, fpn, idx, &pgn)) != NULL)
+  {
+    locked = (owner == mm || owner == vicmm);
+    if (!locked && pthread_mutex_trylock(&owner->mm_lock) != 0)
+    {
+      idx++;
+      continue;
+    }
 
-    /* TODO: Play with your paging theory here */
-    /* Find victim page */
-    if (find_victim_page(mm, &vicpgn) == -1)
+    pte = pte_get(owner, pgn);
+    if (PAGING_PAGE_PRESENT(pte) && PAGING_PTE_FPN(pte) == fpn &&
+        (shm || swp_alloc(caller, &swptyp, &swpfpn) == 0))
     {
-      return -1;
+      ptep = pte_ptr(owner, pgn, 0);
+      if (shm)
+        *ptep = PAGING_PTE_SHM_MASK;
+      else
+      {
+        __mm_swap_page(caller, fpn, swptyp, swpfpn);
+        pte_set_swap(ptep, swptyp, swpfpn);
+        CLRBIT(*ptep, PAGING_PTE_COW_MASK);
+        MEMPHY_set_owner(swp_dev(caller, swptyp), swpfpn, owner, pgn);
+        MM_STAT_INC(swp_out[swptyp]);
+        MM_STAT_INC(pg_writeback);
+        MM_STAT_INC(pg_evict);
+        if (owner != mm)
+          MM_STAT_INC(pg_evict_other);
+      }
+      tlb_flush_page(owner, pgn);
+      mm_pgrep->remove(owner, pgn);
+      owner->rss--;
+      left = MEMPHY_unshare(caller->mram, fpn, owner, pgn);
     }
+    else
+      idx++;
+
+    if (!locked)
+      pthread_mutex_unlock(&owner->mm_lock);
+  }
+
+  return (left == 0) ? fpn : -1;
+}
+
+/*pg_shmevict - take a shared memory victim away from every attacher
+*@mm: faulting mm, its mm_lock is held
+*@vicmm: mm the victim was taken from, locked as well
+*@vicpgn: victim page
+*@swptyp, @swpfpn: slot reserved for the victim
+*@caller: caller
+*
+* The page goes to the slot, which its segment then owns, only once no
+* attacher maps the frame any more. Return the frame then, -1 otherwise
+*/
+static int pg_shmevict(struct mm_struct *mm, struct mm_struct *vicmm, int vicpgn,
+                       int swptyp, int swpfpn, struct pcb_t *caller)
+{
+  int idx;
+  int fpn = PAGING_PTE_FPN(pte_get(vicmm, vicpgn));
+  struct shm_seg *seg = shm_find(vicmm, vicpgn, &idx);
+
+  pthread_mutex_lock(&seg->lock);
+  fpn = pg_unmap_sharers(mm, vicmm, fpn, 1, caller);
+  if (fpn >= 0)
+  {
+    __mm_swap_page(caller, fpn, swptyp, swpfpn);
+    pte_set_swap(&seg->page[idx], swptyp, swpfpn);
+    MM_STAT_INC(swp_out[swptyp]);
+    MM_STAT_INC(pg_writeback);
+    MM_STAT_INC(pg_evict);
+    if (vicmm != mm)
+      MM_STAT_INC(pg_evict_other);
+  }
+  else
+    swp_free(caller, swptyp, swpfpn);
+  pthread_mutex_unlock(&seg->lock);
+
+  return fpn;
+}
+
+/*pg_evict - swap a resident page out to make room
+*@mm: faulting mm, its mm_lock is held
+*@pgn: faulting page
+*@retfpn: returned frame the victim left, -1 if nothing was freed
+*@local: take the victim from @mm first, even in global mode
+*@caller: caller
+*
+* A COW shared victim goes to a slot of its own, then the other mms
+* mapping the frame are made to let go of it as well. A shm victim is
+* unmapped from every attacher and written back once, see pg_shmevict
+*/
+static int pg_evict(struct mm_struct *mm, int pgn, int *retfpn, int local, struct pcb_t *caller)
+{
+  int vicpgn, swpfpn, swptyp;
+  int vicfpn, shared;
+  uint32_t vicpte, *vicptep;
+  struct mm_struct *vicmm = mm;
+
+  /* Get the swap device and frame the victim goes to */
+  if (swp_alloc(caller, &swptyp, &swpfpn) == -1)
+  {
+    return -1;
+  }
 
-    /* Get the victim frame number */
-    if (MEMPHY_get_freefp(caller->active_mswp, &swpfpn) == -1)
+  /* Find victim page, system wide in global mode, when the sweep
+  * gives up the faulting mm evicts one of its own pages. An mm left
+  * with nothing resident, e.g. its COW shared frames were taken along
+  * with another mm's victim, takes one system wide in local mode too */
+  if (local || !pgrep_global ||
+      pgrep_global_victim(mm, caller->mram, &vicmm, &vicpgn) != 0)
+  {
+    vicmm = mm;
+    if (find_victim_page(mm, pgn, &vicpgn) == -1 &&
+        ((pgrep_global && !local) ||
+         pgrep_global_victim(mm, caller->mram, &vicmm, &vicpgn) != 0))
     {
+      swp_free(caller, swptyp, swpfpn);
       return -1;
     }
+  }
+
+  vicpte = pte_get(vicmm, vicpgn);
+  if (vicpte & PAGING_PTE_SHM_MASK)
+  {
+    *retfpn = pg_shmevict(mm, vicmm, vicpgn, swptyp, swpfpn, caller);
+    if (vicmm != mm)
+      pthread_mutex_unlock(&vicmm->mm_lock);
+    return 0;
+  }
 
-    vicpte = mm->pgd[vicpgn];
-    vicfpn = PAGING_PTE_FPN(vicpte);
+  vicfpn = PAGING_PTE_FPN(vicpte);
+  shared = (vicpte & PAGING_PTE_COW_MASK) && MEMPHY_get_refcnt(caller->mram, vicfpn) > 1;
 
-    /* TODO: Implement swap frame from MEMRAM to MEMSWP and vice versa*/
+  /* A clean page swapped in earlier still owns its swap slot, shared
+  * frames never keep one */
+  int cpytyp;
+  int cpyfpn = shared ? -1 : MEMPHY_get_swpcopy(caller->mram, vicfpn, &cpytyp);
+  if (cpyfpn >= 0)
+  {
+    swp_free(caller, swptyp, swpfpn);
+    swptyp = cpytyp;
+    swpfpn = cpyfpn;
+  }
 
-    /* TODO copy victim frame to swap
+  if (cpyfpn >= 0 && !(vicpte & PAGING_PTE_DIRTY_MASK))
+    MM_STAT_INC(pg_wb_clean); /* swap copy is up to date */
+  else
+  {
+    /* Copy victim frame to swap
     * SWP(vicfpn <--> swpfpn)
     * SYSCALL 17 sys_memmap
     * with operation SYSMEM_SWP_OP
     */
-    // __swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
-
     struct sc_regs regs;
     regs.a1 = SYSMEM_SWP_OP; // Operation code for swap
     regs.a2 = vicfpn  ; // Source frame number (victim frame)
     regs.a3 = swpfpn; // Destination frame number (swap frame)
-
-    // /* SYSCALL 17 sys_memmap */
+    regs.a4 = swptyp; // Destination swap device
 
     // syscall(caller, 17, &regs) is __sys_memmap(caller, &regs);
     __sys_memmap(caller, &regs); // Perform the swap operation
-    pte_set_swap(&caller->mm->pgd[vicpgn], 0, swpfpn);
+    MM_STAT_INC(pg_writeback);
+  }
+  vicptep = pte_ptr(vicmm, vicpgn, 0);
+  pte_set_swap(vicptep, swptyp, swpfpn);
+  CLRBIT(*vicptep, PAGING_PTE_COW_MASK); /* the slot is private */
+  if (vicpte & PAGING_PTE_RA_MASK)
+  {
+    /* Read ahead for nothing, the window of its mm was too large */
+    CLRBIT(*vicptep, PAGING_PTE_RA_MASK);
+    vicmm->ra_win /= 2;
+    MM_STAT_INC(ra_miss);
+  }
+  MEMPHY_set_owner(swp_dev(caller, swptyp), swpfpn, vicmm, vicpgn);
+  MM_STAT_INC(swp_out[swptyp]);
+  tlb_flush_page(vicmm, vicpgn);
+  vicmm->rss--;
+  MM_STAT_INC(pg_evict);
 
-    /* TODO copy target frame form swap to mem
-    * SWP(tgtfpn <--> vicfpn)
-    * SYSCALL 17 sys_memmap
-    * with operation SYSMEM_SWP_OP
-    */
-    __swap_cp_page(caller->active_mswp, tgtfpn, caller->mram, vicfpn);
-    /* TODO copy target frame form swap to mem
-    //regs.a1 =...
-    //regs.a2 =...
-    //regs.a3 =..
-    */
-    /* Update page table */
-    // pte_set_swap()
-    // mm->pgd;
-    pte_set_swap(&caller->mm->pgd[pgn], 0, swpfpn);
-    /* Update its online status of the target page */
-    // pte_set_fpn() &
-    // mm->pgd[pgn];
-    // pte_set_fpn();
-    pte_set_fpn(&caller->mm->pgd[pgn], vicfpn);
+  if (shared && MEMPHY_unshare(caller->mram, vicfpn, vicmm, vicpgn) > 0)
+    vicfpn = pg_unmap_sharers(mm, vicmm, vicfpn, 0, caller);
 
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
+  if (vicmm != mm)
+  {
+    MM_STAT_INC(pg_evict_other);
+    pthread_mutex_unlock(&vicmm->mm_lock);
   }
 
-  *fpn = PAGING_FPN(mm->pgd[pgn]);
-
+  *retfpn = vicfpn;
   return 0;
 }
 
-/*pg_getval - read value at given offset
-*@mm: memory region
-*@addr: virtual address to acess
-*@value: value
+/*pg_getframe - get a free RAM frame, evicting pages if RAM is full
+*@mm: faulting mm, its mm_lock is held
+*@pgn: faulting page
+*@fpn: returned frame
+*@caller: caller
 *
+* A COW shared victim that some busy mm still maps frees nothing, so
+* victims are taken until one of them leaves a frame behind. An mm at
+* its RSS limit replaces within its own working set, free RAM or not
 */
-int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
+static int pg_getframe(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
 {
-  int pgn = PAGING_PGN(addr);
-  int off = PAGING_OFFST(addr);
-  int fpn;
+  int local = (mm->rss_max > 0 && mm->rss >= mm->rss_max);
 
-  /* Get the page to MEMRAM, swap from MEMSWAP if needed */
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
-    return -1; /* invalid page access */
+  if (!local && MEMPHY_get_freefp(caller->mram, fpn) == 0)
+    return 0; /* RAM is not full yet, nobody has to go */
 
-  /* TODO
-  *  MEMPHY_read(caller->mram, phyaddr, data);
-  *  MEMPHY READ
-  *  SYSCALL 17 sys_memmap with SYSMEM_IO_READ
-  */
-  int phyaddr = (fpn << PAGING_ADDR_PGN_LOBIT) + off;
-  // MEMPHY_read(caller->mram, phyaddr, data);
-  
-  struct sc_regs regs;
-  regs.a1 = SYSMEM_IO_READ;
-  regs.a2 = phyaddr;
-  regs.a3 = (uint32_t)(*data);
+  if (local)
+    MM_STAT_INC(rss_evict);
+
+  do
+  {
+    if (pg_evict(mm, pgn, fpn, local, caller) != 0)
+      return -1;
+  } while (*fpn < 0);
 
-  // syscall(caller, 17, &regs) is __sys_memmap(caller, &regs);
-  __sys_memmap(caller, &regs);
-  *data = (BYTE)regs.a3; // Update the data with the read value
   return 0;
 }
 
-/*pg_setval - write value to given offset
+/*pg_fill - bring a non resident page in on a free frame
 *@mm: memory region
-*@addr: virtual address to acess
-*@value: value
+*@pgn: PGN
+*@fpn: free frame
+*@caller: caller
 *
+* The page is listed for replacement first, if it cannot be the frame
+* goes back and -1 is returned
 */
-int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
+static int pg_fill(struct mm_struct *mm, int pgn, int fpn, struct pcb_t *caller)
 {
-  int pgn = PAGING_PGN(addr);
-  int off = PAGING_OFFST(addr);
-  int fpn;
+  /* Read the target frame storing our variable and its swap device only
+  * now, making room in a swap tier may have moved it
+  */
+  uint32_t *ptep = pte_ptr(mm, pgn, 0);
+  uint32_t pte = *ptep;
+  int tgtfpn = PAGING_PTE_SWP(pte);
+  int tgttyp = PAGING_PTE_SWPTYP(pte);
 
-  /* Get the page to MEMRAM, swap from MEMSWAP if needed */
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
-    return -1; /* invalid page access */
+  if (pgrep_insert(mm, pgn) != 0)
+  {
+    MEMPHY_put_freefp(caller->mram, fpn);
+    return -1;
+  }
 
-  /* TODO
-  *  MEMPHY_write(caller->mram, phyaddr, value);
-  *  MEMPHY WRITE
-  *  SYSCALL 17 sys_memmap with SYSMEM_IO_WRITE
+  /* Copy target frame form swap to mem, a page that was never
+  * backed by a frame (e.g. mapping ran out of RAM) starts zeroed
   */
-  int phyaddr = (fpn << PAGING_ADDR_PGN_LOBIT) + off;
-
-  MEMPHY_write(caller->mram, phyaddr, value);
+  if (PAGING_PAGE_SWAPPED(pte))
+  {
+    int slots = __swap_cp_page(swp_dev(caller, tgttyp), tgtfpn, caller->mram, fpn);
+    if (slots > 0)
+      caller->stall += slots; /* seek of a sequential swap device */
+    MM_STAT_INC(pg_swapin);
+  }
+  else
+  {
+    MEMPHY_write_page(caller->mram, fpn, NULL);
+    MM_STAT_INC(pg_zerofill);
+  }
 
-  struct sc_regs regs;
-  regs.a1 = SYSMEM_IO_WRITE;
-  regs.a2 = phyaddr;
-  regs.a3 = value;
+  /* Update its online status of the target page, clean until written,
+  * a swapped in page keeps tgtfpn as its swap copy */
+  pte_set_fpn(ptep, fpn);
+  CLRBIT(*ptep, PAGING_PTE_DIRTY_MASK);
+  CLRBIT(*ptep, PAGING_PTE_COW_MASK);
+  CLRBIT(*ptep, PAGING_PTE_RA_MASK);
+  MEMPHY_set_owner(caller->mram, fpn, mm, pgn);
+  if (PAGING_PAGE_SWAPPED(pte))
+    MEMPHY_set_swpcopy(caller->mram, fpn, tgttyp, tgtfpn);
 
-  // syscall(caller, 17, &regs) is __sys_memmap(caller, &regs);
-  __sys_memmap(caller, &regs);
   return 0;
 }
 
-/*__read - read value in region memory
+/*pg_shmfault - map a shared memory page on the frame of its segment
+*@mm: memory region
+*@pgn: PGN, not present
 *@caller: caller
-*@vmaid: ID vm area to alloc memory region
-*@offset: offset to acess in memory region
-*@rgid: memory region ID (used to identify variable in symbole table)
-*@size: allocated size
 *
+* An attacher that finds the page resident just maps the frame too, else
+* it brings the page in and the segment records the frame. Making room
+* may evict a page of the same segment, so it is done unlocked
 */
-int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data)
+static int pg_shmfault(struct mm_struct *mm, int pgn, struct pcb_t *caller)
 {
-  pthread_mutex_lock(&mmvm_lock);
-  struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
-  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+  int idx, fpn = -1;
+  uint32_t spte, *ptep;
+  struct shm_seg *seg = shm_find(mm, pgn, &idx);
 
-  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  if (seg == NULL)
     return -1;
 
-  pg_getval(caller->mm, currg->rg_start + offset, data, caller);
+  pthread_mutex_lock(&seg->lock);
+  if (!PAGING_PAGE_PRESENT(seg->page[idx]))
+  {
+    pthread_mutex_unlock(&seg->lock);
+    if (pg_getframe(mm, pgn, &fpn, caller) != 0)
+      return -1;
+    pthread_mutex_lock(&seg->lock);
+  }
 
-  pthread_mutex_unlock(&mmvm_lock);
-  return 0;
-}
+  if (pgrep_insert(mm, pgn) != 0)
+  {
+    pthread_mutex_unlock(&seg->lock);
+    if (fpn >= 0)
+      MEMPHY_put_freefp(caller->mram, fpn);
+    return -1;
+  }
 
-/*libread - PAGING-based read a region memory */
-int libread(
-    struct pcb_t *proc, // Process executing the instruction
-    uint32_t source,    // Index of source register
-    uint32_t offset,    // Source address = [source] + [offset]
-    uint32_t *destination)
-{
-  BYTE data;
-  int val = __read(proc, 0, source, offset, &data);
+  spte = seg->page[idx];
+  if (PAGING_PAGE_PRESENT(spte))
+  {
+    if (fpn >= 0)
+      MEMPHY_put_freefp(caller->mram, fpn); /* another attacher was faster */
+    fpn = PAGING_PTE_FPN(spte);
+    if (MEMPHY_share(caller->mram, fpn, mm, pgn) < 0)
+      MEMPHY_set_owner(caller->mram, fpn, mm, pgn); /* left unmapped, no slot */
+    MM_STAT_INC(shm_hit);
+  }
+  else
+  {
+    if (PAGING_PAGE_SWAPPED(spte))
+    {
+      int slots = __swap_cp_page(swp_dev(caller, PAGING_PTE_SWPTYP(spte)), PAGING_PTE_SWP(spte),
+                                 caller->mram, fpn);
+      if (slots > 0)
+        caller->stall += slots;
+      swp_free(caller, PAGING_PTE_SWPTYP(spte), PAGING_PTE_SWP(spte));
+      MM_STAT_INC(pg_swapin);
+    }
+    else
+    {
+      MEMPHY_write_page(caller->mram, fpn, NULL);
+      MM_STAT_INC(pg_zerofill);
+    }
+    pte_set_fpn(&seg->page[idx], fpn);
+    MEMPHY_set_owner(caller->mram, fpn, mm, pgn);
+  }
 
-  /* TODO update result of reading action*/
-  *destination = (uint32_t)data;
-  // destination
-#ifdef IODUMP
-  printf("===== PHYSICAL MEMORY AFTER READING =====\n");
-  printf("read region=%d offset=%d value=%d\n", source, offset, data);
-#ifdef PAGETBL_DUMP
-  print_pgtbl(proc, 0, -1); // print max TBL
-#endif
-  MEMPHY_dump(proc->mram);
-#endif
+  ptep = pte_ptr(mm, pgn, 0);
+  pte_set_fpn(ptep, fpn);
+  SETBIT(*ptep, PAGING_PTE_SHM_MASK);
+  pthread_mutex_unlock(&seg->lock);
 
-  return val;
+  return 0;
 }
 
-/*__write - write a region memory
+/*pg_lmap - map a whole large page block on an aligned frame run
+*@mm: memory region, its mm_lock is held
+*@pgn: any page of the block
 *@caller: caller
-*@vmaid: ID vm area to alloc memory region
-*@offset: offset to acess in memory region
-*@rgid: memory region ID (used to identify variable in symbole table)
-*@size: allocated size
 *
+* Only a block none of whose pages was ever backed qualifies. It is
+* mapped zeroed at once, so touching its other pages faults no more.
+* No frame is evicted to make a run, nor is a block mapped past the
+* RSS limit: it is then left to pg_getpage page by page and -1 is returned
 */
-int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value)
+int pg_lmap(struct mm_struct *mm, int pgn, struct pcb_t *caller)
 {
-  pthread_mutex_lock(&mmvm_lock);
-  struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
-  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+  int base = pgn & ~(PAGING_LPAGE_NR - 1);
+  int i, fpn;
 
-  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  for (i = 0; i < PAGING_LPAGE_NR; i++)
+    if (pte_get(mm, base + i) != PAGING_PTE_LARGE_MASK)
+      return -1;
+
+  if (mm->rss_max > 0 && mm->rss + PAGING_LPAGE_NR > mm->rss_max)
+    return -1;
+
+  if (MEMPHY_get_freerun(caller->mram, PAGING_LPAGE_NR, &fpn) != 0)
+  {
+    MM_STAT_INC(lpage_split);
     return -1;
+  }
 
-  pg_setval(caller->mm, currg->rg_start + offset, value, caller);
+  MEMPHY_write_range(caller->mram, fpn * PAGING_PAGESZ, NULL, 0,
+                     PAGING_LPAGE_NR * PAGING_PAGESZ);
+  for (i = 0; i < PAGING_LPAGE_NR; i++)
+  {
+    if (pgrep_insert(mm, base + i) != 0)
+    { /* the pages left fault in one by one */
+      for (; i < PAGING_LPAGE_NR; i++)
+        MEMPHY_put_freefp(caller->mram, fpn + i);
+      return (pgn < base + i) ? 0 : -1;
+    }
+    pte_set_fpn(pte_ptr(mm, base + i, 0), fpn + i);
+    MEMPHY_set_owner(caller->mram, fpn + i, mm, base + i);
+  }
+  MM_STAT_INC(lpage_map);
 
-  pthread_mutex_unlock(&mmvm_lock);
   return 0;
 }
 
-/*libwrite - PAGING-based write a region memory */
-int libwrite(
-    struct pcb_t *proc,   // Process executing the instruction
-    BYTE data,            // Data to be wrttien into memory
+int mm_readahead;
+
+/*pg_readahead - read in the swapped pages following a sequential fault
+*@mm: memory region, its mm_lock is held
+*@pgn: faulting page, swapped out
+*@caller: caller
+*
+* A fault on the page right after the last one brought in doubles the
+* window of the mm, up to mm_readahead pages and a quarter of RAM or of
+* its RSS limit, and
+* that many swapped pages of the same area are read in. It is done
+* before the faulting page comes in, so making room for them can never
+* evict it. They carry PAGING_PTE_RA_MASK until used, one evicted
+* unused halves the window, see pg_evict
+*/
+static void pg_readahead(struct mm_struct *mm, int pgn, struct pcb_t *caller)
+{
+  struct vm_area_struct *vma;
+  int p, fpn, max;
+  uint32_t *ptep;
+
+  if (pgn != mm->ra_next)
+  {
+    mm->ra_next = pgn + 1; /* random, wait for a second fault in a row */
+    return;
+  }
+
+  max = ((mm->rss_max > 0) ? mm->rss_max : caller->mram->numfp) / 4;
+  if (max > mm_readahead)
+    max = mm_readahead;
+  mm->ra_win = (mm->ra_win > 0) ? mm->ra_win * 2 : 2;
+  if (mm->ra_win > max)
+    mm->ra_win = max;
+
+  for (vma = mm->mmap; vma != NULL; vma = vma->vm_next)
+    if (pgn * PAGING_PAGESZ >= vma->vm_start && pgn * PAGING_PAGESZ < vma->vm_end)
+      break;
+
+  for (p = pgn + 1; vma != NULL && p <= pgn + mm->ra_win && p * PAGING_PAGESZ < vma->vm_end; p++)
+  {
+    ptep = pte_ptr(mm, p, 0);
+    if (ptep == NULL || !PAGING_PAGE_SWAPPED(*ptep) || (*ptep & PAGING_PTE_SHM_MASK) ||
+        pg_getframe(mm, p, &fpn, caller) != 0)
+      break;
+
+    if (pg_fill(mm, p, fpn, caller) != 0)
+      break;
+    SETBIT(*ptep, PAGING_PTE_RA_MASK);
+    MM_STAT_INC(ra_page);
+  }
+  mm->ra_next = p;
+}
+
+/*pg_getpage - get the page in ram
+*@mm: memory region
+*@pagenum: PGN
+*@framenum: return FPN
+*@caller: caller
+*
+*/
+int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+{
+  printf("pg_getpage: pgn=%d\n", pgn);
+  MM_STAT_INC(pg_access);
+  if (tlb_lookup(mm, pgn, fpn) == 0)
+  {
+    pgrep_access(mm, pgn);
+    return 0;
+  }
+
+  /* A page never touched may still miss its page table page */
+  uint32_t *ptep = pte_map(mm, pgn);
+
+  if (ptep == NULL)
+    return -1;
+
+  uint32_t pte = *ptep;
+
+  if (!PAGING_PAGE_PRESENT(pte))
+  { /* Page is not online, make it actively living */
+    int vicfpn;
+
+    MM_STAT_INC(pg_fault);
+
+    if (pte & PAGING_PTE_SHM_MASK)
+    {
+      if (pg_shmfault(mm, pgn, caller) != 0)
+        return -1;
+    }
+    else if (pte != PAGING_PTE_LARGE_MASK || pg_lmap(mm, pgn, caller) != 0)
+    {
+      if (mm_readahead > 0 && PAGING_PAGE_SWAPPED(pte))
+        pg_readahead(mm, pgn, caller);
+
+      if (pg_getframe(mm, pgn, &vicfpn, caller) != 0 ||
+          pg_fill(mm, pgn, vicfpn, caller) != 0)
+        return -1;
+    }
+  }
+  else
+  {
+    if (pte & PAGING_PTE_RA_MASK)
+    {
+      CLRBIT(*ptep, PAGING_PTE_RA_MASK); /* read ahead, one fault saved */
+      MM_STAT_INC(ra_hit);
+    }
+    pgrep_access(mm, pgn);
+  }
+
+  *fpn = PAGING_FPN(*ptep);
+  tlb_fill(mm, pgn, *fpn);
+
+  return 0;
+}
+
+/*pg_cowbreak - give a COW page a private frame before it is written
+*@mm: memory region
+*@pgn: PGN, resident
+*@fpn: FPN the page is mapped on, updated to the private frame
+*@caller: caller
+*
+* The last mm left on a shared frame simply takes it over. Making room
+* for the copy may evict the page itself, it then comes back private
+*/
+static int pg_cowbreak(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+{
+  int newfpn;
+  uint32_t *ptep = pte_ptr(mm, pgn, 0);
+
+  if (!(*ptep & PAGING_PTE_COW_MASK))
+    return 0;
+
+  if (MEMPHY_get_refcnt(caller->mram, *fpn) > 1)
+  {
+    if (pg_getframe(mm, pgn, &newfpn, caller) != 0)
+      return -1;
+
+    if (PAGING_PAGE_PRESENT(*ptep))
+    {
+      MEMPHY_copy_frames(caller->mram, *fpn, caller->mram, newfpn, 1);
+      if (MEMPHY_unshare(caller->mram, *fpn, mm, pgn) == 0)
+        MEMPHY_put_freefp(caller->mram, *fpn); /* the others let go meanwhile */
+      pte_set_fpn(ptep, newfpn);
+      MEMPHY_set_owner(caller->mram, newfpn, mm, pgn);
+      MM_STAT_INC(pg_cow);
+    }
+    else if (pg_fill(mm, pgn, newfpn, caller) != 0)
+      return -1;
+  }
+
+  CLRBIT(*ptep, PAGING_PTE_COW_MASK);
+  *fpn = PAGING_FPN(*ptep);
+  tlb_fill(mm, pgn, *fpn);
+
+  return 0;
+}
+
+/*__populate - back a range with frames right away
+*@caller: caller
+*@addr: start of the range
+*@size: number of bytes
+*
+* In demand paging mode this is the eager mapping alloc used to do,
+* otherwise the pages are mapped already and it is only a walk
+*/
+int __populate(struct pcb_t *caller, int addr, int size)
+{
+  int last = addr + size - 1;
+  int pgn, fpn, val = 0;
+
+  pthread_mutex_lock(&caller->mm->mm_lock);
+  for (pgn = PAGING_PGN(addr); pgn <= PAGING_PGN(last) && val == 0; pgn++)
+    val = pg_getpage(caller->mm, pgn, &fpn, caller);
+  pthread_mutex_unlock(&caller->mm->mm_lock);
+
+  return val;
+}
+
+/*pg_getval - read value at given offset
+*@mm: memory region
+*@addr: virtual address to acess
+*@value: value
+*
+*/
+int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
+{
+  int pgn = PAGING_PGN(addr);
+  int off = PAGING_OFFST(addr);
+  int fpn;
+
+  /* Get the page to MEMRAM, swap from MEMSWAP if needed */
+  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+    return -1; /* invalid page access */
+
+  /* TODO
+  *  MEMPHY_read(caller->mram, phyaddr, data);
+  *  MEMPHY READ
+  *  SYSCALL 17 sys_memmap with SYSMEM_IO_READ
+  */
+  int phyaddr = (fpn << PAGING_ADDR_PGN_LOBIT) + off;
+  // MEMPHY_read(caller->mram, phyaddr, data);
+  
+  struct sc_regs regs;
+  regs.a1 = SYSMEM_IO_READ;
+  regs.a2 = phyaddr;
+  regs.a3 = (uint32_t)(*data);
+
+  // syscall(caller, 17, &regs) is __sys_memmap(caller, &regs);
+  __sys_memmap(caller, &regs);
+  *data = (BYTE)regs.a3; // Update the data with the read value
+  return 0;
+}
+
+/*pg_mkdirty - mark a page written
+*@mm: memory region
+*@pgn: PGN
+*@fpn: FPN the page is mapped on
+*@caller: caller
+*
+* The swap copy kept since swap in is stale from the first write on,
+* its slot goes back to the swap device instead of waiting for eviction
+*/
+static void pg_mkdirty(struct mm_struct *mm, int pgn, int fpn, struct pcb_t *caller)
+{
+  int swpfpn, swptyp;
+  uint32_t *ptep = pte_ptr(mm, pgn, 0);
+
+  if (*ptep & PAGING_PTE_DIRTY_MASK)
+    return;
+
+  SETBIT(*ptep, PAGING_PTE_DIRTY_MASK);
+  swpfpn = MEMPHY_take_swpcopy(caller->mram, fpn, &swptyp);
+  if (swpfpn >= 0)
+    swp_free(caller, swptyp, swpfpn);
+}
+
+/*pg_setval - write value to given offset
+*@mm: memory region
+*@addr: virtual address to acess
+*@value: value
+*
+*/
+int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
+{
+  int pgn = PAGING_PGN(addr);
+  int off = PAGING_OFFST(addr);
+  int fpn;
+
+  /* Get the page to MEMRAM, swap from MEMSWAP if needed */
+  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+    return -1; /* invalid page access */
+
+  /* TODO
+  *  MEMPHY_write(caller->mram, phyaddr, value);
+  *  MEMPHY WRITE
+  *  SYSCALL 17 sys_memmap with SYSMEM_IO_WRITE
+  */
+  if (pg_cowbreak(mm, pgn, &fpn, caller) != 0)
+    return -1;
+
+  int phyaddr = (fpn << PAGING_ADDR_PGN_LOBIT) + off;
+
+  pg_mkdirty(mm, pgn, fpn, caller);
+  MEMPHY_write(caller->mram, phyaddr, value);
+
+  struct sc_regs regs;
+  regs.a1 = SYSMEM_IO_WRITE;
+  regs.a2 = phyaddr;
+  regs.a3 = value;
+
+  // syscall(caller, 17, &regs) is __sys_memmap(caller, &regs);
+  __sys_memmap(caller, &regs);
+  return 0;
+}
+
+/*pg_getrange - read a byte range starting at given address
+*@mm: memory region
+*@addr: virtual address to acess
+*@buf: destination buffer
+*@len: number of bytes
+*
+* The page is translated once and then walked, instead of one
+* pg_getpage per byte as with pg_getval
+*/
+int pg_getrange(struct mm_struct *mm, int addr, BYTE *buf, int len, struct pcb_t *caller)
+{
+  while (len > 0)
+  {
+    int off = PAGING_OFFST(addr);
+    int chunk = PAGING_PAGESZ - off;
+    int fpn;
+
+    if (chunk > len)
+      chunk = len;
+
+    if (pg_getpage(mm, PAGING_PGN(addr), &fpn, caller) != 0)
+      return -1; /* invalid page access */
+
+    int phyaddr = (fpn << PAGING_ADDR_PGN_LOBIT) + off;
+    MEMPHY_read_range(caller->mram, phyaddr, buf, chunk);
+
+    addr += chunk;
+    buf += chunk;
+    len -= chunk;
+  }
+
+  return 0;
+}
+
+/*pg_setrange - write a byte range starting at given address
+*@mm: memory region
+*@addr: virtual address to acess
+*@buf: source buffer, NULL to fill with @value
+*@value: fill value when @buf is NULL
+*@len: number of bytes
+*
+*/
+int pg_setrange(struct mm_struct *mm, int addr, const BYTE *buf, BYTE value, int len, struct pcb_t *caller)
+{
+  while (len > 0)
+  {
+    int off = PAGING_OFFST(addr);
+    int chunk = PAGING_PAGESZ - off;
+    int fpn;
+
+    if (chunk > len)
+      chunk = len;
+
+    if (pg_getpage(mm, PAGING_PGN(addr), &fpn, caller) != 0 ||
+        pg_cowbreak(mm, PAGING_PGN(addr), &fpn, caller) != 0)
+      return -1; /* invalid page access */
+
+    int phyaddr = (fpn << PAGING_ADDR_PGN_LOBIT) + off;
+    pg_mkdirty(mm, PAGING_PGN(addr), fpn, caller);
+    MEMPHY_write_range(caller->mram, phyaddr, buf, value, chunk);
+
+    addr += chunk;
+    if (buf)
+      buf += chunk;
+    len -= chunk;
+  }
+
+  return 0;
+}
+
+/*get_rg_range - check a byte range lies inside an allocated region
+*@mm: memory region
+*@rgid: memory region ID
+*@offset: offset in memory region
+*@len: range length
+*
+*Return the region or NULL if the range is out of it
+*/
+static struct vm_rg_struct *get_rg_range(struct mm_struct *mm, int rgid, int offset, int len)
+{
+  struct vm_rg_struct *currg = get_symrg_byid(mm, rgid);
+
+  if (currg == NULL || offset < 0 || len < 0)
+    return NULL;
+
+  if (currg->rg_start == 0 && currg->rg_end == 0) /* Not allocated */
+    return NULL;
+
+  if (currg->rg_start + offset + len > currg->rg_end)
+    return NULL;
+
+  return currg;
+}
+
+/*__memset - fill a range in region memory
+*@caller: caller
+*@vmaid: ID vm area to alloc memory region
+*@rgid: memory region ID (used to identify variable in symbole table)
+*@offset: offset to acess in memory region
+*@len: number of bytes
+*@value: fill value
+*
+*/
+int __memset(struct pcb_t *caller, int vmaid, int rgid, int offset, int len, BYTE value)
+{
+  pthread_mutex_lock(&caller->mm->mm_lock);
+  struct vm_rg_struct *currg = get_rg_range(caller->mm, rgid, offset, len);
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  {
+    pthread_mutex_unlock(&caller->mm->mm_lock);
+    return -1;
+  }
+
+  int val = pg_setrange(caller->mm, currg->rg_start + offset, NULL, value, len, caller);
+
+  pthread_mutex_unlock(&caller->mm->mm_lock);
+  return val;
+}
+
+/*__memcpy - copy a range between region memories
+*@caller: caller
+*@vmaid: ID vm area to alloc memory region
+*@dstrg: destination region ID
+*@dstoff: offset in destination region
+*@srcrg: source region ID
+*@srcoff: offset in source region
+*@len: number of bytes
+*
+*Overlapping ranges are copied as memmove does. Data goes through a page
+*sized bounce buffer, so faulting in the destination page can never
+*evict the source frame under our feet
+*/
+int __memcpy(struct pcb_t *caller, int vmaid, int dstrg, int dstoff, int srcrg, int srcoff, int len)
+{
+  BYTE buf[BIT(PAGING_PGSHIFT_MAX)];
+
+  pthread_mutex_lock(&caller->mm->mm_lock);
+  struct vm_rg_struct *dst = get_rg_range(caller->mm, dstrg, dstoff, len);
+  struct vm_rg_struct *src = get_rg_range(caller->mm, srcrg, srcoff, len);
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if (dst == NULL || src == NULL || cur_vma == NULL) /* Invalid memory identify */
+  {
+    pthread_mutex_unlock(&caller->mm->mm_lock);
+    return -1;
+  }
+
+  int dstaddr = dst->rg_start + dstoff;
+  int srcaddr = src->rg_start + srcoff;
+  int backward = (dstaddr > srcaddr && dstaddr < srcaddr + len);
+  int done = 0;
+
+  while (done < len)
+  {
+    int chunk = (len - done < PAGING_PAGESZ) ? len - done : PAGING_PAGESZ;
+    int pos = backward ? len - done - chunk : done;
+
+    if (pg_getrange(caller->mm, srcaddr + pos, buf, chunk, caller) != 0 ||
+        pg_setrange(caller->mm, dstaddr + pos, buf, 0, chunk, caller) != 0)
+    {
+      pthread_mutex_unlock(&caller->mm->mm_lock);
+      return -1;
+    }
+    done += chunk;
+  }
+
+  pthread_mutex_unlock(&caller->mm->mm_lock);
+  return 0;
+}
+
+/*libmemset - PAGING-based fill a range of a region memory */
+int libmemset(
+    struct pcb_t *proc,   // Process executing the instruction
+    uint32_t destination, // Index of destination register
+    uint32_t offset,      // Destination address = [destination] + [offset]
+    uint32_t len,         // Number of bytes
+    BYTE value)           // Fill value
+{
+  int val = __memset(proc, 0, destination, offset, len, value);
+#ifdef IODUMP
+  printf("===== PHYSICAL MEMORY AFTER MEMSET =====\n");
+  printf("memset region=%d offset=%d len=%d value=%d\n", destination, offset, len, value);
+#ifdef PAGETBL_DUMP
+  print_pgtbl(proc, 0, -1); // print max TBL
+#endif
+  MEMPHY_dump(proc->mram);
+#endif
+
+  return val;
+}
+
+/*libmemcpy - PAGING-based copy a range between region memories */
+int libmemcpy(
+    struct pcb_t *proc,   // Process executing the instruction
+    uint32_t destination, // Index of destination register
+    uint32_t dstoff,      // Destination address = [destination] + [dstoff]
+    uint32_t source,      // Index of source register
+    uint32_t srcoff,      // Source address = [source] + [srcoff]
+    uint32_t len)         // Number of bytes
+{
+  int val = __memcpy(proc, 0, destination, dstoff, source, srcoff, len);
+#ifdef IODUMP
+  printf("===== PHYSICAL MEMORY AFTER MEMCPY =====\n");
+  printf("memcpy region=%d offset=%d <- region=%d offset=%d len=%d\n",
+         destination, dstoff, source, srcoff, len);
+#ifdef PAGETBL_DUMP
+  print_pgtbl(proc, 0, -1); // print max TBL
+#endif
+  MEMPHY_dump(proc->mram);
+#endif
+
+  return val;
+}
+
+/*__read_range - read a byte range in region memory
+*@caller: caller
+*@vmaid: ID vm area to alloc memory region
+*@rgid: memory region ID (used to identify variable in symbole table)
+*@offset: offset to acess in memory region
+*@buf: destination buffer
+*@len: number of bytes
+*
+*/
+int __read_range(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *buf, int len)
+{
+  pthread_mutex_lock(&caller->mm->mm_lock);
+  struct vm_rg_struct *currg = get_rg_range(caller->mm, rgid, offset, len);
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  {
+    pthread_mutex_unlock(&caller->mm->mm_lock);
+    return -1;
+  }
+
+  int val = pg_getrange(caller->mm, currg->rg_start + offset, buf, len, caller);
+
+  pthread_mutex_unlock(&caller->mm->mm_lock);
+  return val;
+}
+
+/*__write_range - write a byte range in region memory
+*@caller: caller
+*@vmaid: ID vm area to alloc memory region
+*@rgid: memory region ID (used to identify variable in symbole table)
+*@offset: offset to acess in memory region
+*@buf: source buffer
+*@len: number of bytes
+*
+*/
+int __write_range(struct pcb_t *caller, int vmaid, int rgid, int offset, const BYTE *buf, int len)
+{
+  pthread_mutex_lock(&caller->mm->mm_lock);
+  struct vm_rg_struct *currg = get_rg_range(caller->mm, rgid, offset, len);
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  {
+    pthread_mutex_unlock(&caller->mm->mm_lock);
+    return -1;
+  }
+
+  int val = pg_setrange(caller->mm, currg->rg_start + offset, buf, 0, len, caller);
+
+  pthread_mutex_unlock(&caller->mm->mm_lock);
+  return val;
+}
+
+/*libreadw - PAGING-based read a little endian word of a region memory */
+int libreadw(
+    struct pcb_t *proc, // Process executing the instruction
+    uint32_t source,    // Index of source register
+    uint32_t offset,    // Source address = [source] + [offset]
+    uint32_t width,     // Word width in bits: 8, 16, 32 or 64
+    uint64_t *destination)
+{
+  BYTE buf[sizeof(uint64_t)];
+  int nbytes = width / BITS_PER_BYTE;
+  int i, val = -1;
+
+  *destination = 0;
+  if (width == 8 || width == 16 || width == 32 || width == 64)
+    val = __read_range(proc, 0, source, offset, buf, nbytes);
+
+  if (val == 0)
+    for (i = nbytes - 1; i >= 0; i--)
+      *destination = (*destination << BITS_PER_BYTE) | (uint8_t)buf[i];
+#ifdef IODUMP
+  printf("===== PHYSICAL MEMORY AFTER READING =====\n");
+  printf("readw region=%d offset=%d width=%d value=%" PRIu64 "\n", source, offset, width, *destination);
+#ifdef PAGETBL_DUMP
+  print_pgtbl(proc, 0, -1); // print max TBL
+#endif
+  MEMPHY_dump(proc->mram);
+#endif
+
+  return val;
+}
+
+/*libwritew - PAGING-based write a little endian word of a region memory */
+int libwritew(
+    struct pcb_t *proc,   // Process executing the instruction
+    uint64_t data,        // Data to be wrttien into memory
+    uint32_t destination, // Index of destination register
+    uint32_t offset,      // Destination address = [destination] + [offset]
+    uint32_t width)       // Word width in bits: 8, 16, 32 or 64
+{
+  BYTE buf[sizeof(uint64_t)];
+  int nbytes = width / BITS_PER_BYTE;
+  int i, val = -1;
+
+  for (i = 0; i < nbytes && i < sizeof(buf); i++)
+    buf[i] = (BYTE)(data >> (i * BITS_PER_BYTE));
+
+  if (width == 8 || width == 16 || width == 32 || width == 64)
+    val = __write_range(proc, 0, destination, offset, buf, nbytes);
+#ifdef IODUMP
+  printf("===== PHYSICAL MEMORY AFTER WRITING =====\n");
+  printf("writew region=%d offset=%d width=%d value=%" PRIu64 "\n", destination, offset, width, data);
+#ifdef PAGETBL_DUMP
+  print_pgtbl(proc, 0, -1); // print max TBL
+#endif
+  MEMPHY_dump(proc->mram);
+#endif
+
+  return val;
+}
+
+/*libreadv - PAGING-based read a short vector of a region memory */
+int libreadv(
+    struct pcb_t *proc, // Process executing the instruction
+    uint32_t source,    // Index of source register
+    uint32_t offset,    // Source address = [source] + [offset]
+    uint32_t len,       // Number of bytes, at most VREG_SZ
+    BYTE *destination)
+{
+  int val = -1;
+
+  if (len <= VREG_SZ)
+    val = __read_range(proc, 0, source, offset, destination, len);
+#ifdef IODUMP
+  printf("===== PHYSICAL MEMORY AFTER READING =====\n");
+  printf("readv region=%d offset=%d len=%d\n", source, offset, len);
+#ifdef PAGETBL_DUMP
+  print_pgtbl(proc, 0, -1); // print max TBL
+#endif
+  MEMPHY_dump(proc->mram);
+#endif
+
+  return val;
+}
+
+/*libwritev - PAGING-based write a short vector of a region memory */
+int libwritev(
+    struct pcb_t *proc,   // Process executing the instruction
+    const BYTE *data,     // Data to be wrttien into memory
+    uint32_t destination, // Index of destination register
+    uint32_t offset,      // Destination address = [destination] + [offset]
+    uint32_t len)         // Number of bytes, at most VREG_SZ
+{
+  int val = -1;
+
+  if (len <= VREG_SZ)
+    val = __write_range(proc, 0, destination, offset, data, len);
+#ifdef IODUMP
+  printf("===== PHYSICAL MEMORY AFTER WRITING =====\n");
+  printf("writev region=%d offset=%d len=%d\n", destination, offset, len);
+#ifdef PAGETBL_DUMP
+  print_pgtbl(proc, 0, -1); // print max TBL
+#endif
+  MEMPHY_dump(proc->mram);
+#endif
+
+  return val;
+}
+
+/*__read - read value in region memory
+*@caller: caller
+*@vmaid: ID vm area to alloc memory region
+*@offset: offset to acess in memory region
+*@rgid: memory region ID (used to identify variable in symbole table)
+*@size: allocated size
+*
+*/
+int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data)
+{
+  pthread_mutex_lock(&caller->mm->mm_lock);
+  struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  {
+    pthread_mutex_unlock(&caller->mm->mm_lock);
+    return -1;
+  }
+
+  int val = pg_getval(caller->mm, currg->rg_start + offset, data, caller);
+
+  pthread_mutex_unlock(&caller->mm->mm_lock);
+  return val;
+}
+
+/*libread - PAGING-based read a region memory */
+int libread(
+    struct pcb_t *proc, // Process executing the instruction
+    uint32_t source,    // Index of source register
+    uint32_t offset,    // Source address = [source] + [offset]
+    uint32_t *destination)
+{
+  BYTE data;
+  int val = __read(proc, 0, source, offset, &data);
+
+  /* TODO update result of reading action*/
+  *destination = (uint32_t)data;
+  // destination
+#ifdef IODUMP
+  printf("===== PHYSICAL MEMORY AFTER READING =====\n");
+  printf("read region=%d offset=%d value=%d\n", source, offset, data);
+#ifdef PAGETBL_DUMP
+  print_pgtbl(proc, 0, -1); // print max TBL
+#endif
+  MEMPHY_dump(proc->mram);
+#endif
+
+  return val;
+}
+
+/*__write - write a region memory
+*@caller: caller
+*@vmaid: ID vm area to alloc memory region
+*@offset: offset to acess in memory region
+*@rgid: memory region ID (used to identify variable in symbole table)
+*@size: allocated size
+*
+*/
+int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value)
+{
+  pthread_mutex_lock(&caller->mm->mm_lock);
+  struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  {
+    pthread_mutex_unlock(&caller->mm->mm_lock);
+    return -1;
+  }
+
+  int val = pg_setval(caller->mm, currg->rg_start + offset, value, caller);
+
+  pthread_mutex_unlock(&caller->mm->mm_lock);
+  return val;
+}
+
+/*libwrite - PAGING-based write a region memory */
+int libwrite(
+    struct pcb_t *proc,   // Process executing the instruction
+    BYTE data,            // Data to be wrttien into memory
     uint32_t destination, // Index of destination register
     uint32_t offset)
 {
@@ -528,80 +1368,251 @@ int libwrite(
   return val;
 }
 
-/*free_pcb_memphy - collect all memphy of pcb
+/*free_pcb_memph - tear down the memory of a finished process
 *@caller: caller
-*@vmaid: ID vm area to alloc memory region
-*@incpgnum: number of page
+*
+* Only the pages on the mapped list are visited: their frames and swap
+* slots go back to the devices with their reverse map entries cleared, a
+* COW or shm shared frame stays with the other mms. With VMDBG the
+* reverse maps are swept after, for entries the walk missed. The page table, areas, free regions and replacement lists
+* are freed after, the mm is left empty with a NULL pgd. With MM_STATS
+* the peak RSS of the process is reported on the way
 */
 int free_pcb_memph(struct pcb_t *caller)
 {
-  pthread_mutex_lock(&mmvm_lock);
-  int pagenum, fpn;
-  uint32_t pte;
+  struct mm_struct *mm = caller->mm;
+  struct vm_area_struct *vma;
+  int i, pagenum, fpn, swpfpn, swptyp;
+  uint32_t *ptep, pte;
 
-  for (pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
+  pthread_mutex_lock(&mm->mm_lock);
+  if (mm->pgd == NULL)
   {
-    pte = caller->mm->pgd[pagenum];
+    pthread_mutex_unlock(&mm->mm_lock);
+    return 0; /* already torn down */
+  }
+
+  tlb_flush_all(mm);
+
+  while (mm->shm != NULL)
+    shm_detach(caller, mm->shm->pgn * PAGING_PAGESZ);
+
+  for (i = 0; i < mm->nmapped; i++)
+  {
+    pagenum = mm->mapped[i];
+    ptep = pte_ptr(mm, pagenum, 0);
+    pte = *ptep;
+    *ptep = 0; /* a page mapped again after a shm detach is listed twice */
 
-    if (!PAGING_PAGE_PRESENT(pte))
+    if (PAGING_PAGE_PRESENT(pte))
     {
+      /* A COW shared frame stays with the other mms */
       fpn = PAGING_PTE_FPN(pte);
+      if (MEMPHY_unshare(caller->mram, fpn, mm, pagenum) != 0)
+        continue;
+      swpfpn = MEMPHY_take_swpcopy(caller->mram, fpn, &swptyp);
+      if (swpfpn >= 0)
+        swp_free(caller, swptyp, swpfpn);
+      MEMPHY_set_owner(caller->mram, fpn, NULL, 0);
       MEMPHY_put_freefp(caller->mram, fpn);
     }
-    else
+    else if (PAGING_PAGE_SWAPPED(pte))
     {
-      fpn = PAGING_PTE_SWP(pte);
-      MEMPHY_put_freefp(caller->active_mswp, fpn);
+      /* swp_free clears the owner of the slot as well */
+      swp_free(caller, PAGING_PTE_SWPTYP(pte), PAGING_PTE_SWP(pte));
     }
   }
+  MM_STAT_ADD(pg_teardown, mm->nmapped);
+#ifdef MM_STATS
+  if (mm->rss_max > 0)
+    printf("\tPID %d: RSS peak %d pages, limit %d\n", caller->pid, mm->rss_peak, mm->rss_max);
+  else
+    printf("\tPID %d: RSS peak %d pages\n", caller->pid, mm->rss_peak);
+#endif
+
+  for (i = 0; i < PAGING_PGD_NENT; i++)
+    free(mm->pgd[i]);
+  free(mm->pgd);
+  mm->pgd = NULL;
+  free(mm->mapped);
+  mm->mapped = NULL;
+  mm->nmapped = mm->mapped_cap = 0;
+
+  while ((vma = mm->mmap) != NULL)
+  {
+    mm->mmap = vma->vm_next;
+    vm_freerg_clear(&vma->vm_freerg);
+    free(vma);
+  }
+  pgrep_init(mm);
+  mm->rss = 0;
+
+#ifdef VMDBG
+  /* alloc_pcb clears the mm, mm_lock included, when the PCB slot is
+  * handed out again, so no frame or swap slot may still lead to it */
+  for (i = 0; i < PAGING_MAX_MMSWP; i++)
+    if (MEMPHY_drop_owner(swp_dev(caller, i), mm) != 0)
+      printf("\tPID %d: swap %d still names the mm\n", caller->pid, i);
+  if (MEMPHY_drop_owner(caller->mram, mm) != 0)
+    printf("\tPID %d: RAM still names the mm\n", caller->pid);
+#endif
+  MM_STAT_INC(mm_teardown);
 
-  pthread_mutex_unlock(&mmvm_lock);
+  pthread_mutex_unlock(&mm->mm_lock);
   return 0;
 }
 
-/*find_victim_page - find victim page
-*@caller: caller
-*@pgn: return page number
+/*fork_pcb_memph - give a forked child a copy of the caller memory
+*@caller: parent
+*@child: child, its mm initialized and empty
 *
+* Resident pages are shared copy on write: both PTEs get the COW bit and
+* the frame one more reference, pg_setval copies it on the first write.
+* A shared frame drops the swap copy it may keep, that copy could only
+* stand for one mm. Swapped pages are copied to a slot of the child,
+* attached shared memory stays shared. On failure the child holds what
+* was shared so far, free_pcb_memph gives it back
 */
-int find_victim_page(struct mm_struct *mm, int *retpgn)
+int fork_pcb_memph(struct pcb_t *caller, struct pcb_t *child)
 {
-  struct pgn_t *pg = mm->fifo_pgn;
-  if (!pg)
+  struct mm_struct *mm = caller->mm;
+  struct mm_struct *cmm = child->mm;
+  struct vm_area_struct *vma, *cvma, **clink;
+  struct vm_rg_struct *rg;
+  int pgn, fpn, swpfpn, swptyp, i, slots;
+  int val = 0;
+  uint32_t pte, *ptep, *cptep;
+
+  pthread_mutex_lock(&mm->mm_lock);
+  pthread_mutex_lock(&cmm->mm_lock);
+
+  /* Areas and their free regions, vma0 comes with init_mm */
+  for (vma = mm->mmap, clink = &cmm->mmap; vma != NULL && val == 0; vma = vma->vm_next)
   {
-    return -1; /* No page in the list */
+    cvma = *clink;
+    if (cvma == NULL && (cvma = malloc(sizeof(struct vm_area_struct))) == NULL)
+    {
+      val = -1;
+      break;
+    }
+    cvma->vm_id = vma->vm_id;
+    cvma->vm_start = vma->vm_start;
+    cvma->vm_end = vma->vm_end;
+    cvma->sbrk = vma->sbrk;
+    cvma->vm_mm = cmm;
+    cvma->vm_next = NULL;
+    vm_freerg_init(&cvma->vm_freerg);
+    *clink = cvma;
+    clink = &cvma->vm_next;
+
+    for (i = 0; i < VM_FREERG_NBINS; i++)
+      for (rg = vma->vm_freerg.bin[i]; rg != NULL; rg = rg->rg_next)
+        vm_freerg_insert(&cvma->vm_freerg, init_vm_rg(rg->rg_start, rg->rg_end));
   }
 
-  /* TODO: Implement the theorical mechanism to find the victim page */
-  if (pg->pg_next == NULL)
+  for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++)
   {
-    *retpgn = pg->pgn;
-    mm->fifo_pgn = NULL;
-    free(pg);
-    return 0;
+    cmm->symrgtbl[i].rg_start = mm->symrgtbl[i].rg_start;
+    cmm->symrgtbl[i].rg_end = mm->symrgtbl[i].rg_end;
   }
 
-  struct pgn_t *prev = pg;
-  struct pgn_t *curr = pg->pg_next;
+  if (val == 0)
+    val = shm_fork(mm, cmm);
 
-  /* Find the last node and its predecessor */
-  while (curr != NULL && curr->pg_next != NULL)
+  for (pgn = 0; pgn < PAGING_MAX_PGN && val == 0; pgn++)
   {
-    prev = curr;
-    curr = curr->pg_next;
-  }
+    ptep = pte_ptr(mm, pgn, 0);
+    if (ptep == NULL)
+    {
+      pgn |= PAGING_PGT_NENT - 1; /* no page table page, skip it */
+      continue;
+    }
+    pte = *ptep;
+    if (pte != 0 && (cptep = pte_map(cmm, pgn)) == NULL)
+    {
+      val = -1;
+      break;
+    }
 
-  /* Now curr points to the last node (or is NULL) */
-  if (curr != NULL)
-  {
-    *retpgn = curr->pgn;
-    prev->pg_next = NULL;
-    free(curr);
-    return 0;
+    if (pte & PAGING_PTE_SHM_MASK)
+    {
+      /* Shared memory stays shared, the child maps the same frame */
+      if (PAGING_PAGE_PRESENT(pte) && MEMPHY_share(caller->mram, PAGING_PTE_FPN(pte), cmm, pgn) < 0)
+      {
+        val = -1;
+        break;
+      }
+      *cptep = pte;
+      if (PAGING_PAGE_PRESENT(pte) && pgrep_insert(cmm, pgn) != 0)
+      {
+        val = -1; /* mapped, the teardown of the child unshares it */
+        break;
+      }
+    }
+    else if (PAGING_PAGE_PRESENT(pte))
+    {
+      fpn = PAGING_PTE_FPN(pte);
+      if (MEMPHY_share(caller->mram, fpn, cmm, pgn) < 0)
+      {
+        val = -1;
+        break;
+      }
+      swpfpn = MEMPHY_take_swpcopy(caller->mram, fpn, &swptyp);
+      if (swpfpn >= 0)
+      {
+        swp_free(caller, swptyp, swpfpn);
+        SETBIT(*ptep, PAGING_PTE_DIRTY_MASK);
+      }
+      SETBIT(*ptep, PAGING_PTE_COW_MASK);
+      *cptep = *ptep;
+      if (pgrep_insert(cmm, pgn) != 0)
+      {
+        val = -1;
+        break;
+      }
+      MM_STAT_INC(fork_shared);
+    }
+    else if (PAGING_PAGE_SWAPPED(pte))
+    {
+      /* Making room in a swap tier may move the parent slot, read the
+      * PTE again once ours is taken */
+      if (swp_alloc(caller, &swptyp, &swpfpn) != 0)
+      {
+        val = -1;
+        break;
+      }
+      pte = *ptep;
+      slots = MEMPHY_copy_frames(swp_dev(caller, PAGING_PTE_SWPTYP(pte)), PAGING_PTE_SWP(pte),
+                                 swp_dev(caller, swptyp), swpfpn, 1);
+      if (slots > 0)
+        caller->stall += slots;
+      *cptep = pte;
+      pte_set_swap(cptep, swptyp, swpfpn);
+      MEMPHY_set_owner(swp_dev(caller, swptyp), swpfpn, cmm, pgn);
+      MM_STAT_INC(swp_out[swptyp]);
+    }
+    else if (pte != 0)
+      *cptep = pte; /* page of a large page block never touched */
   }
 
-  /* This should never be reached if the list is properly formed */
-  return -1;
+  if (val == 0)
+    MM_STAT_INC(fork_cnt);
+
+  pthread_mutex_unlock(&cmm->mm_lock);
+  pthread_mutex_unlock(&mm->mm_lock);
+  return val;
+}
+
+/*find_victim_page - find victim page
+*@mm: memory region
+*@pgn: faulting page, adaptive policies (ARC) look at its history
+*@retpgn: return page number
+*
+*The victim is chosen and unlisted by the policy selected for the run
+*/
+int find_victim_page(struct mm_struct *mm, int pgn, int *retpgn)
+{
+  return mm_pgrep->victim(mm, pgn, retpgn);
 }
 
 /*get_free_vmrg_area - get a free vm region
@@ -614,64 +1625,13 @@ int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_s
 {
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
 
-  struct vm_rg_struct *rgit = cur_vma->vm_freerg_list;
-
-  if (rgit == NULL)
+  if (cur_vma == NULL || size <= 0)
     return -1;
 
   /* Probe unintialized newrg */
   newrg->rg_start = newrg->rg_end = -1;
 
-  /* TODO Traverse on list of free vm region to find a fit space */
-  // while (...)
-  //  ..
-  while (rgit != NULL)
-  {
-    if (rgit->rg_start + size <= rgit->rg_end)
-    { /* Current region has enough space */
-      newrg->rg_start = rgit->rg_start;
-      newrg->rg_end = rgit->rg_start + size;
-
-      /* Update left space in chosen region */
-      if (rgit->rg_start + size < rgit->rg_end)
-      {
-        rgit->rg_start = rgit->rg_start + size;
-      }
-      else
-      { /*Use up all space, remove current node */
-        /*Clone next rg node */
-        struct vm_rg_struct *nextrg = rgit->rg_next;
-
-        /*Cloning */
-        if (nextrg != NULL)
-        {
-          rgit->rg_start = nextrg->rg_start;
-          rgit->rg_end = nextrg->rg_end;
-
-          rgit->rg_next = nextrg->rg_next;
-
-          free(nextrg);
-        }
-        else
-        {                                /*End of free list */
-          rgit->rg_start = rgit->rg_end; // dummy, size 0 region
-          rgit->rg_next = NULL;
-        }
-      }
-      break;
-    }
-    else
-    {
-      rgit = rgit->rg_next; // Traverse next rg
-    }
-  }
-
-  if (newrg->rg_start == -1 && newrg->rg_end == -1)
-  {
-    return -1; /* No suitable region found */
-  }
-
-  return 0; /* Region found successfully */
+  return vm_freerg_take(&cur_vma->vm_freerg, size, newrg);
 }
 
 // #endif
\ No newline at end of file
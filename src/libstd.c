@@ -15,13 +15,15 @@ int libsyscall (struct pcb_t *caller,
              uint32_t syscall_idx,
              uint32_t a1,
              uint32_t a2,
-             uint32_t a3)
+             uint32_t a3,
+             uint32_t a4)
 {
    struct sc_regs regs;
 
    regs.a1 = a1;
    regs.a2 = a2;
    regs.a3 = a3;
+   regs.a4 = a4;
 
    return syscall(caller, syscall_idx, &regs);
 }
\ No newline at end of file
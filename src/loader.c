@@ -3,15 +3,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <inttypes.h>
 
 static uint32_t avail_pid = 1;
 
+/* PCB slab: pages of PCB_SLAB_CHUNK slots, added as more processes are
+ * live at once and never given back. Slot [n] is in page [n / CHUNK],
+ * hot and cold parts in separate arrays so the dispatch path only pulls
+ * the hot line */
+struct pcb_page_t {
+	struct pcb_t slab[PCB_SLAB_CHUNK];
+	struct pcb_cold_t cold_slab[PCB_SLAB_CHUNK];
+};
+
+static struct pcb_page_t ** pcb_pages;
+static uint32_t pcb_npages;
+static uint32_t pcb_next; /* next fit cursor over the slots */
+static pthread_mutex_t pcb_lock = PTHREAD_MUTEX_INITIALIZER;
+
 #define OPT_CALC	"calc"
 #define OPT_ALLOC	"alloc"
 #define OPT_FREE	"free"
 #define OPT_READ	"read"
 #define OPT_WRITE	"write"
 #define OPT_SYSCALL	"syscall"
+#define OPT_MEMSET	"memset"
+#define OPT_MEMCPY	"memcpy"
+#define OPT_READW	"readw"
+#define OPT_WRITEW	"writew"
+#define OPT_READV	"readv"
+#define OPT_WRITEV	"writev"
+#define OPT_REPEAT	"repeat"
+#define OPT_END		"end"
 
 static enum ins_opcode_t get_opcode(char * opt) {
 	if (!strcmp(opt, OPT_CALC)) {
@@ -26,21 +50,159 @@ static enum ins_opcode_t get_opcode(char * opt) {
 		return WRITE;
 	}else if (!strcmp(opt, OPT_SYSCALL)) {
 		return SYSCALL;
+	}else if (!strcmp(opt, OPT_MEMSET)) {
+		return MEMSET;
+	}else if (!strcmp(opt, OPT_MEMCPY)) {
+		return MEMCPY;
+	}else if (!strcmp(opt, OPT_READW)) {
+		return READW;
+	}else if (!strcmp(opt, OPT_WRITEW)) {
+		return WRITEW;
+	}else if (!strcmp(opt, OPT_READV)) {
+		return READV;
+	}else if (!strcmp(opt, OPT_WRITEV)) {
+		return WRITEV;
+	}else if (!strcmp(opt, OPT_REPEAT)) {
+		return REPEAT;
+	}else if (!strcmp(opt, OPT_END)) {
+		return END;
 	}else{
 		printf("get_opcode return Opcode: %s\n", opt);
 		exit(1);
 	}
 }
 
+/*pcb_grow - add one page of free slots to the slab, pcb_lock held
+*
+* Return 0, -1 when out of memory.
+*/
+static int pcb_grow(void) {
+	struct pcb_page_t ** pages;
+	struct pcb_page_t * page;
+
+	pages = realloc(pcb_pages, sizeof(*pages) * (pcb_npages + 1));
+	if (pages == NULL)
+		return -1;
+	pcb_pages = pages;
+
+	page = aligned_alloc(PCB_CACHELINE_SZ, sizeof(*page));
+	if (page == NULL)
+		return -1;
+	memset(page, 0, sizeof(*page));
+	pcb_pages[pcb_npages++] = page;
+	return 0;
+}
+
+/*alloc_pcb - take a PCB slot from the slab
+*
+* The search goes on from the slot handed out last, the slab grows by a
+* page once every slot is live. Slots keep their text buffer across
+* reuse. Return NULL when no page can be added.
+*/
+struct pcb_t * alloc_pcb(void) {
+	struct pcb_t * proc = NULL;
+	struct pcb_cold_t * cold = NULL;
+	uint32_t tries, nslots;
+
+	pthread_mutex_lock(&pcb_lock);
+	nslots = pcb_npages * PCB_SLAB_CHUNK;
+	for (tries = 0; tries < nslots; tries++) {
+		pcb_next = (pcb_next + 1) % nslots;
+		proc = &pcb_pages[pcb_next / PCB_SLAB_CHUNK]->slab[pcb_next % PCB_SLAB_CHUNK];
+		if (proc->pid == 0)
+			break;
+		proc = NULL;
+	}
+	if (proc == NULL && pcb_grow() == 0) {
+		pcb_next = nslots;
+		proc = &pcb_pages[pcb_next / PCB_SLAB_CHUNK]->slab[0];
+	}
+	if (proc != NULL) {
+		if (avail_pid == 0) /* pid 0 marks a free slot */
+			avail_pid++;
+		proc->pid = avail_pid++;
+		cold = &pcb_pages[pcb_next / PCB_SLAB_CHUNK]->cold_slab[pcb_next % PCB_SLAB_CHUNK];
+	}
+	pthread_mutex_unlock(&pcb_lock);
+
+	if (proc == NULL)
+		return NULL;
+
+	struct inst_t * text = cold->code_store.text;
+	uint32_t text_cap = cold->text_cap;
+
+	memset(cold, 0, sizeof(*cold));
+	cold->code_store.text = text;
+	cold->text_cap = text_cap;
+
+	proc->pc = 0;
+	proc->stall = 0;
+	proc->code = &cold->code_store;
+	proc->cold = cold;
+	return proc;
+}
+
+/*free_pcb - return a PCB slot to the slab */
+void free_pcb(struct pcb_t * proc) {
+	if (proc == NULL)
+		return;
+
+	pthread_mutex_lock(&pcb_lock);
+	proc->pid = 0;
+	pthread_mutex_unlock(&pcb_lock);
+}
+
+/*dup_pcb - take a PCB slot for a copy of a running process
+*
+* The child gets its own text, registers and loop counters and resumes
+* at the same pc. Its memory is set up by the caller.
+* Return NULL when the slab cannot grow.
+*/
+struct pcb_t * dup_pcb(struct pcb_t * proc) {
+	struct pcb_t * child = alloc_pcb();
+
+	if (child == NULL)
+		return NULL;
+
+	if (proc->code->size > child->cold->text_cap) {
+		free(child->code->text);
+		child->code->text = (struct inst_t*)malloc(
+			sizeof(struct inst_t) * proc->code->size
+		);
+		child->cold->text_cap = proc->code->size;
+	}
+	memcpy(child->code->text, proc->code->text,
+		sizeof(struct inst_t) * proc->code->size);
+	child->code->size = proc->code->size;
+
+	child->pc = proc->pc;
+	child->priority = proc->priority;
+#ifdef MLQ_SCHED
+	child->prio = proc->prio;
+#endif
+	memcpy(child->cold->path, proc->cold->path, sizeof(child->cold->path));
+	memcpy(child->cold->regs, proc->cold->regs, sizeof(child->cold->regs));
+	memcpy(child->cold->vreg, proc->cold->vreg, sizeof(child->cold->vreg));
+	memcpy(child->cold->loop_cnt, proc->cold->loop_cnt,
+		sizeof(child->cold->loop_cnt));
+	child->cold->bp = proc->cold->bp;
+	return child;
+}
+
 struct pcb_t * load(const char * path) {
 	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
-	proc->page_table =
-		(struct page_table_t*)malloc(sizeof(struct page_table_t));
-	proc->bp = PAGE_SIZE;
-	proc->pc = 0;
+	struct pcb_t * proc = alloc_pcb();
+	if (proc == NULL) {
+		printf("Out of memory for a PCB loading '%s'\n", path);
+		return NULL;
+	}
+#ifndef MM_PAGING
+	/* Legacy segmentation only, paging keeps its tables in mm_struct */
+	if (proc->cold->page_table == NULL)
+		proc->cold->page_table =
+			(struct page_table_t*)malloc(sizeof(struct page_table_t));
+#endif
+	proc->cold->bp = PAGE_SIZE;
 
 	/* Read process code from file */
 	FILE * file;
@@ -48,15 +210,22 @@ struct pcb_t * load(const char * path) {
 		printf("Cannot find process description at '%s'\n", path);
 		exit(1);		
 	}
-	snprintf(proc->path, 2*sizeof(path)+1, "%s", path);
+	snprintf(proc->cold->path, sizeof(proc->cold->path), "%s", path);
 	char opcode[10];
-	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
 	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
-	);
+	if (proc->code->size > proc->cold->text_cap) {
+		free(proc->code->text);
+		proc->code->text = (struct inst_t*)malloc(
+			sizeof(struct inst_t) * proc->code->size
+		);
+		proc->cold->text_cap = proc->code->size;
+	}
 	uint32_t i = 0;
+	uint64_t imm;
+	uint32_t loop_open[LOOP_MAX_DEPTH]; // Index of the open REPEATs
+	uint32_t depth = 0;
 	char buf[200];
+	char flag[16];
 	for (i = 0; i < proc->code->size; i++) {
 		fscanf(file, "%s", opcode);
 		proc->code->text[i].opcode = get_opcode(opcode);
@@ -64,18 +233,29 @@ struct pcb_t * load(const char * path) {
 		case CALC:
 			break;
 		case ALLOC:
-			fscanf(
-				file,
-				"%u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1
+			/* alloc SIZE REG [populate], arg_2 maps the frames now
+			 * even in demand paging mode */
+			fgets(buf, sizeof(buf), file);
+			flag[0] = '\0';
+			sscanf(buf, "%u %u %15s",
+			           &proc->code->text[i].arg_0,
+			           &proc->code->text[i].arg_1,
+			           flag
 			);
+			if (flag[0] != '\0' && strcmp(flag, "populate")) {
+				printf("Unknown alloc flag '%s' in '%s'\n", flag, path);
+				exit(1);
+			}
+			proc->code->text[i].arg_2 = (flag[0] != '\0');
 			break;
 		case FREE:
 			fscanf(file, "%u\n", &proc->code->text[i].arg_0);
 			break;
 		case READ:
 		case WRITE:
+		case READW:
+		case READV:
+		case WRITEV:
 			fscanf(
 				file,
 				"%u %u %u\n",
@@ -86,11 +266,70 @@ struct pcb_t * load(const char * path) {
 			break;	
 		case SYSCALL:
 			fgets(buf, sizeof(buf), file);
-			sscanf(buf, "%d%d%d%d",
+			sscanf(buf, "%d%d%d%d%d",
 			           &proc->code->text[i].arg_0,
 			           &proc->code->text[i].arg_1,
 			           &proc->code->text[i].arg_2,
-			           &proc->code->text[i].arg_3
+			           &proc->code->text[i].arg_3,
+			           &proc->code->text[i].arg_4
+			);
+			break;
+		case WRITEW:
+			/* 64-bit immediate, split in arg_0 (low) and arg_4 (high) */
+			fscanf(
+				file,
+				"%" SCNu64 " %u %u %u\n",
+				&imm,
+				&proc->code->text[i].arg_1,
+				&proc->code->text[i].arg_2,
+				&proc->code->text[i].arg_3
+			);
+			proc->code->text[i].arg_0 = (uint32_t)imm;
+			proc->code->text[i].arg_4 = (uint32_t)(imm >> 32);
+			break;
+		case REPEAT:
+			/* Pre-decode the loop: arg_0 count, arg_1 matching END,
+			 * arg_2 nesting depth used to index pcb loop counters */
+			if (depth == LOOP_MAX_DEPTH) {
+				printf("Loop nested deeper than %d in '%s'\n",
+					LOOP_MAX_DEPTH, path);
+				exit(1);
+			}
+			fscanf(file, "%u\n", &proc->code->text[i].arg_0);
+			proc->code->text[i].arg_2 = depth;
+			loop_open[depth++] = i;
+			break;
+		case END:
+			/* arg_0 matching REPEAT, arg_1 nesting depth */
+			if (depth == 0) {
+				printf("Unmatched end at instruction %u in '%s'\n",
+					i, path);
+				exit(1);
+			}
+			depth--;
+			proc->code->text[i].arg_0 = loop_open[depth];
+			proc->code->text[i].arg_1 = depth;
+			proc->code->text[loop_open[depth]].arg_1 = i;
+			break;
+		case MEMSET:
+			fscanf(
+				file,
+				"%u %u %u %u\n",
+				&proc->code->text[i].arg_0,
+				&proc->code->text[i].arg_1,
+				&proc->code->text[i].arg_2,
+				&proc->code->text[i].arg_3
+			);
+			break;
+		case MEMCPY:
+			fscanf(
+				file,
+				"%u %u %u %u %u\n",
+				&proc->code->text[i].arg_0,
+				&proc->code->text[i].arg_1,
+				&proc->code->text[i].arg_2,
+				&proc->code->text[i].arg_3,
+				&proc->code->text[i].arg_4
 			);
 			break;
 		default:
@@ -98,6 +337,11 @@ struct pcb_t * load(const char * path) {
 			exit(1);
 		}
 	}
+	fclose(file);
+	if (depth != 0) {
+		printf("Unterminated repeat in '%s'\n", path);
+		exit(1);
+	}
 	return proc;
 }
 
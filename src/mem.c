@@ -71,7 +71,7 @@ static int translate(
 	
 	/* Search in the first level */
 	struct trans_table_t * trans_table = NULL;
-	trans_table = get_trans_table(first_lv, proc->page_table);
+	trans_table = get_trans_table(first_lv, proc->cold->page_table);
 	if (trans_table == NULL) {
 		return 0;
 	}
@@ -106,8 +106,8 @@ addr_t alloc_mem(uint32_t size, struct pcb_t * proc) {
 	
 	if (mem_avail) {
 		/* We could allocate new memory region to the process */
-		ret_mem = proc->bp;
-		proc->bp += num_pages * PAGE_SIZE;
+		ret_mem = proc->cold->bp;
+		proc->cold->bp += num_pages * PAGE_SIZE;
 		/* Update status of physical pages which will be allocated
 		 * to [proc] in _mem_stat. Tasks to do:
 		 * 	- Update [proc], [index], and [next] field
@@ -8,25 +8,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 /*
 *  MEMPHY_mv_csr - move MEMPHY cursor
 *  @mp: memphy struct
 *  @offset: offset
+*  The head travels from where the last access left it, the distance is
+*  charged as latency: one time slot per seek_rate bytes crossed.
+*  Return the time slots the seek takes
 */
 int MEMPHY_mv_csr(struct memphy_struct *mp, int offset)
 {
-   int numstep = 0;
+   int dist = abs(offset - mp->cursor);
 
-   mp->cursor = 0;
-   while (numstep < offset && numstep < mp->maxsz)
-   {
-      /* Traverse sequentially */
-      mp->cursor = (mp->cursor + 1) % mp->maxsz;
-      numstep++;
-   }
+   mp->cursor = offset;
 
-   return 0;
+   if (mp->seek_rate <= 0 || dist == 0)
+      return 0;
+
+   MM_STAT_ADD(dev_seek_bytes, dist);
+   MM_STAT_ADD(dev_seek_slots, DIV_ROUND_UP(dist, mp->seek_rate));
+   return DIV_ROUND_UP(dist, mp->seek_rate);
 }
 
 /*
@@ -34,19 +40,23 @@ int MEMPHY_mv_csr(struct memphy_struct *mp, int offset)
 *  @mp: memphy struct
 *  @addr: address
 *  @value: obtained value
+*  Return the time slots the access takes, -1 on error
 */
 int MEMPHY_seq_read(struct memphy_struct *mp, int addr, BYTE *value)
 {
-   if (mp == NULL)
+   int slots;
+
+   if (mp == NULL || addr < 0 || addr >= mp->maxsz)
       return -1;
 
-   if (!mp->rdmflg)
+   if (mp->rdmflg)
       return -1; /* Not compatible mode for sequential read */
 
-   MEMPHY_mv_csr(mp, addr);
+   slots = MEMPHY_mv_csr(mp, addr);
    *value = (BYTE)mp->storage[addr];
+   mp->cursor = addr + 1;
 
-   return 0;
+   return slots;
 }
 
 /*
@@ -73,20 +83,23 @@ int MEMPHY_read(struct memphy_struct *mp, int addr, BYTE *value)
 *  @mp: memphy struct
 *  @addr: address
 *  @data: written data
+*  Return the time slots the access takes, -1 on error
 */
 int MEMPHY_seq_write(struct memphy_struct *mp, int addr, BYTE value)
 {
+   int slots;
 
-   if (mp == NULL)
+   if (mp == NULL || addr < 0 || addr >= mp->maxsz)
       return -1;
 
-   if (!mp->rdmflg)
-      return -1; /* Not compatible mode for sequential read */
+   if (mp->rdmflg)
+      return -1; /* Not compatible mode for sequential write */
 
-   MEMPHY_mv_csr(mp, addr);
+   slots = MEMPHY_mv_csr(mp, addr);
    mp->storage[addr] = value;
+   mp->cursor = addr + 1;
 
-   return 0;
+   return slots;
 }
 
 /*
@@ -108,56 +121,277 @@ int MEMPHY_write(struct memphy_struct *mp, int addr, BYTE data)
    return 0;
 }
 
+/*
+*  MEMPHY_seek - place the cursor for a bulk transfer
+*  @mp: memphy struct
+*  @addr: first byte of the transfer
+*  @len: number of bytes
+*  A sequential device moves its cursor once per transfer, not per byte,
+*  and is left past the last byte transferred.
+*  Return the time slots the seek takes, -1 on error
+*/
+static int MEMPHY_seek(struct memphy_struct *mp, int addr, int len)
+{
+   int slots = 0;
+
+   if (mp == NULL || addr < 0 || len < 0 || addr + len > mp->maxsz)
+      return -1;
+
+   if (!mp->rdmflg)
+   {
+      slots = MEMPHY_mv_csr(mp, addr);
+      mp->cursor = addr + len;
+   }
+
+   return slots;
+}
+
+/*
+*  MEMPHY_read_range - read a byte range of MEMPHY device
+*  @mp: memphy struct
+*  @addr: first byte
+*  @buf: destination buffer
+*  @len: number of bytes
+*  Return the time slots the transfer takes, -1 on error
+*/
+int MEMPHY_read_range(struct memphy_struct *mp, int addr, BYTE *buf, int len)
+{
+   int slots = MEMPHY_seek(mp, addr, len);
+
+   if (slots < 0)
+      return -1;
+
+   memcpy(buf, mp->storage + addr, len);
+   return slots;
+}
+
+/*
+*  MEMPHY_write_range - write a byte range of MEMPHY device
+*  @mp: memphy struct
+*  @addr: first byte
+*  @buf: source buffer, NULL to fill with @value
+*  @value: fill value when @buf is NULL
+*  @len: number of bytes
+*  Return the time slots the transfer takes, -1 on error
+*/
+int MEMPHY_write_range(struct memphy_struct *mp, int addr, const BYTE *buf, BYTE value, int len)
+{
+   int slots = MEMPHY_seek(mp, addr, len);
+
+   if (slots < 0)
+      return -1;
+
+   if (buf)
+      memcpy(mp->storage + addr, buf, len);
+   else
+      memset(mp->storage + addr, value, len);
+   return slots;
+}
+
+/*
+*  MEMPHY_read_page - read a whole frame
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @buf: destination buffer of PAGING_PAGESZ bytes
+*/
+int MEMPHY_read_page(struct memphy_struct *mp, int fpn, BYTE *buf)
+{
+   return MEMPHY_read_range(mp, fpn * PAGING_PAGESZ, buf, PAGING_PAGESZ);
+}
+
+/*
+*  MEMPHY_write_page - write a whole frame
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @buf: source buffer of PAGING_PAGESZ bytes, NULL to zero the frame
+*/
+int MEMPHY_write_page(struct memphy_struct *mp, int fpn, const BYTE *buf)
+{
+   return MEMPHY_write_range(mp, fpn * PAGING_PAGESZ, buf, 0, PAGING_PAGESZ);
+}
+
+/*
+*  MEMPHY_copy_frames - copy contiguous frames between devices
+*  @mpsrc: source memphy
+*  @srcfpn: first source frame
+*  @mpdst: destination memphy
+*  @dstfpn: first destination frame
+*  @nframes: number of frames
+*  Return the time slots the transfer takes, -1 on error
+*/
+int MEMPHY_copy_frames(struct memphy_struct *mpsrc, int srcfpn,
+                       struct memphy_struct *mpdst, int dstfpn, int nframes)
+{
+   int len = nframes * PAGING_PAGESZ;
+   int srcslots, dstslots;
+
+   srcslots = MEMPHY_seek(mpsrc, srcfpn * PAGING_PAGESZ, len);
+   dstslots = MEMPHY_seek(mpdst, dstfpn * PAGING_PAGESZ, len);
+   if (srcslots < 0 || dstslots < 0)
+      return -1;
+
+   /* Both ends may be frames of the same device */
+   memmove(mpdst->storage + dstfpn * PAGING_PAGESZ,
+           mpsrc->storage + srcfpn * PAGING_PAGESZ, len);
+   return srcslots + dstslots;
+}
+
 /*
 *  MEMPHY_format-format MEMPHY device
 *  @mp: memphy struct
+*  @pagesz: frame size
+*  Frames above the high water mark were never handed out and need no
+*  bookkeeping. Only recycled frames are tracked, a set bit of the free
+*  bitmap, with one summary bit per bitmap word so one is found in two
+*  lookups. Both start zeroed, which calloc gives lazily, so formatting
+*  costs the same for any device size
 */
 int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
    /* This setting come with fixed constant PAGESZ */
    int numfp = mp->maxsz / pagesz;
-   struct framephy_struct *newfst, *fst;
-   int iter = 0;
+   int nword, nsum;
 
+   /* A device too small for one frame has no free frame at all */
+   mp->numfp = mp->nfree = mp->nfree_low = mp->fp_hint = mp->fp_hwm = 0;
+   mp->fp_bitmap = mp->fp_summary = NULL;
    if (numfp <= 0)
       return -1;
 
-   /* Init head of free framephy list */
-   fst = malloc(sizeof(struct framephy_struct));
-   if(fst == NULL) 
+   nword = (numfp + FP_WORD_BITS - 1) / FP_WORD_BITS;
+   nsum = (nword + FP_WORD_BITS - 1) / FP_WORD_BITS;
+
+   mp->fp_bitmap = calloc(nword, sizeof(uint64_t));
+   mp->fp_summary = calloc(nsum, sizeof(uint64_t));
+   if (mp->fp_bitmap == NULL || mp->fp_summary == NULL)
       return -1;
-      
-   fst->fpn = iter;
-   mp->free_fp_list = fst;
 
-   /* We have list with first element, fill in the rest num-1 element member*/
-   for (iter = 1; iter < numfp; iter++)
-   {
-      newfst = malloc(sizeof(struct framephy_struct));
-      newfst->fpn = iter;
-      newfst->fp_next = NULL;
-      fst->fp_next = newfst;
-      fst = newfst;
-   }
+   mp->numfp = numfp;
+   mp->nfree = mp->nfree_low = numfp;
 
    return 0;
 }
 
+/*
+*  MEMPHY_get_freefp - take a free frame
+*  @mp: memphy struct
+*  @retfpn: returned frame number
+*  Never used frames go first, in ascending order, then the lowest
+*  recycled one
+*/
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
+   int nsum, sum, word, fpn;
 
-   if (fp == NULL)
+   pthread_mutex_lock(&mp->fp_lock);
+   if (mp->nfree == 0)
+   {
+      pthread_mutex_unlock(&mp->fp_lock);
       return -1;
+   }
+
+   if (mp->fp_hwm < mp->numfp)
+   {
+      *retfpn = mp->fp_hwm++;
+      if (--mp->nfree < mp->nfree_low)
+         mp->nfree_low = mp->nfree;
+      pthread_mutex_unlock(&mp->fp_lock);
+      return 0;
+   }
 
-   *retfpn = fp->fpn;
-   mp->free_fp_list = fp->fp_next;
+   /* No summary word below the hint has a free frame */
+   nsum = (mp->numfp + FP_WORD_BITS * FP_WORD_BITS - 1) / (FP_WORD_BITS * FP_WORD_BITS);
+   for (sum = mp->fp_hint; sum < nsum && mp->fp_summary[sum] == 0; sum++)
+      ;
+   mp->fp_hint = sum;
 
-   /* MEMPHY is iteratively used up until its exhausted
-   * No garbage collector acting then it not been released
-   */
-//  free(fp);
+   word = sum * FP_WORD_BITS + __builtin_ctzll(mp->fp_summary[sum]);
+   fpn = word * FP_WORD_BITS + __builtin_ctzll(mp->fp_bitmap[word]);
+
+   mp->fp_bitmap[word] &= ~(1ULL << (fpn % FP_WORD_BITS));
+   if (mp->fp_bitmap[word] == 0)
+      mp->fp_summary[sum] &= ~(1ULL << (word % FP_WORD_BITS));
+   if (--mp->nfree < mp->nfree_low)
+      mp->nfree_low = mp->nfree;
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   *retfpn = fpn;
+   return 0;
+}
+
+/*
+*  MEMPHY_find_run - cut a free run aligned on its length, fp_lock held
+*  @mp: memphy struct
+*  @nframes: run length, a power of two up to FP_WORD_BITS
+*  The never used frames go first, those skipped to align the run are
+*  recycled. Otherwise a bitmap word with the whole run free is looked
+*  for. Return the first frame of the run, -1 if there is none
+*/
+static int MEMPHY_find_run(struct memphy_struct *mp, int nframes)
+{
+   uint64_t mask = (nframes < FP_WORD_BITS) ? (1ULL << nframes) - 1 : ~0ULL;
+   int nsum, sum, word, off;
+   int fpn = (mp->fp_hwm + nframes - 1) & ~(nframes - 1);
+   uint64_t bits;
+
+   if (fpn + nframes <= mp->numfp)
+   {
+      for (; mp->fp_hwm < fpn; mp->fp_hwm++)
+      {
+         word = mp->fp_hwm / FP_WORD_BITS;
+         mp->fp_bitmap[word] |= 1ULL << (mp->fp_hwm % FP_WORD_BITS);
+         mp->fp_summary[word / FP_WORD_BITS] |= 1ULL << (word % FP_WORD_BITS);
+         if (word / FP_WORD_BITS < mp->fp_hint)
+            mp->fp_hint = word / FP_WORD_BITS;
+      }
+      mp->fp_hwm += nframes;
+      return fpn;
+   }
+
+   nsum = (mp->numfp + FP_WORD_BITS * FP_WORD_BITS - 1) / (FP_WORD_BITS * FP_WORD_BITS);
+   for (sum = mp->fp_hint; sum < nsum; sum++)
+      for (bits = mp->fp_summary[sum]; bits != 0; bits &= bits - 1)
+      {
+         word = sum * FP_WORD_BITS + __builtin_ctzll(bits);
+         for (off = 0; off < FP_WORD_BITS; off += nframes)
+            if (((mp->fp_bitmap[word] >> off) & mask) == mask)
+            {
+               mp->fp_bitmap[word] &= ~(mask << off);
+               if (mp->fp_bitmap[word] == 0)
+                  mp->fp_summary[sum] &= ~(1ULL << (word % FP_WORD_BITS));
+               return word * FP_WORD_BITS + off;
+            }
+      }
+
+   return -1;
+}
+
+/*
+*  MEMPHY_get_freerun - take a run of free frames aligned on its length
+*  @mp: memphy struct
+*  @nframes: run length, a power of two up to FP_WORD_BITS
+*  @retfpn: returned first frame of the run
+*  Nothing is ever moved to make a run, the caller falls back to frames
+*  taken one by one
+*/
+int MEMPHY_get_freerun(struct memphy_struct *mp, int nframes, int *retfpn)
+{
+   int fpn;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   fpn = (mp->nfree >= nframes) ? MEMPHY_find_run(mp, nframes) : -1;
+   if (fpn < 0)
+   {
+      pthread_mutex_unlock(&mp->fp_lock);
+      return -1;
+   }
 
+   mp->nfree -= nframes;
+   if (mp->nfree < mp->nfree_low)
+      mp->nfree_low = mp->nfree;
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   *retfpn = fpn;
    return 0;
 }
 
@@ -179,36 +413,408 @@ int MEMPHY_dump(struct memphy_struct *mp)
    return 0;
 }
 
+/*
+*  MEMPHY_put_freefp - give a frame back
+*  @mp: memphy struct
+*  @fpn: frame number, refused if never handed out or already free
+*/
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
-   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+   int word = fpn / FP_WORD_BITS;
+   uint64_t bit = 1ULL << (fpn % FP_WORD_BITS);
+
+   if (fpn < 0 || fpn >= mp->numfp)
+      return -1;
 
-   /* Create new node with value fpn */
-   newnode->fpn = fpn;
-   newnode->fp_next = fp;
-   mp->free_fp_list = newnode;
+   pthread_mutex_lock(&mp->fp_lock);
+   if (fpn >= mp->fp_hwm || (mp->fp_bitmap[word] & bit))
+   {
+      pthread_mutex_unlock(&mp->fp_lock);
+      return -1;
+   }
+
+   mp->fp_bitmap[word] |= bit;
+   mp->fp_summary[word / FP_WORD_BITS] |= 1ULL << (word % FP_WORD_BITS);
+   if (word / FP_WORD_BITS < mp->fp_hint)
+      mp->fp_hint = word / FP_WORD_BITS;
+   mp->nfree++;
+   pthread_mutex_unlock(&mp->fp_lock);
 
    return 0;
 }
 
 /*
-*  Init MEMPHY struct
+*  MEMPHY_set_owner - update the reverse map of a frame
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @owner: mm the frame is mapped in, NULL when it is released
+*  @pgn: page of owner mapped on the frame
 */
-int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
+int MEMPHY_set_owner(struct memphy_struct *mp, int fpn, struct mm_struct *owner, int pgn)
+{
+   if (fpn < 0 || fpn >= mp->maxsz / PAGING_PAGESZ)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   mp->rmap[fpn].owner = owner;
+   mp->rmap[fpn].pgn = pgn;
+   mp->rmap[fpn].swpfpn = -1;
+   mp->rmap[fpn].refcnt = (owner != NULL);
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   return 0;
+}
+
+/*
+*  MEMPHY_set_swpcopy - remember the swap slot a frame was filled from
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @swptyp: swap device of the slot
+*  @swpfpn: swap slot, -1 once it no longer matches the frame
+*/
+int MEMPHY_set_swpcopy(struct memphy_struct *mp, int fpn, int swptyp, int swpfpn)
+{
+   if (fpn < 0 || fpn >= mp->maxsz / PAGING_PAGESZ)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   mp->rmap[fpn].swptyp = swptyp;
+   mp->rmap[fpn].swpfpn = swpfpn;
+   pthread_mutex_unlock(&mp->fp_lock);
+   return 0;
+}
+
+/*
+*  MEMPHY_get_swpcopy - swap slot holding a copy of the frame, -1 if none
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @swptyp: returned swap device of the slot
+*/
+int MEMPHY_get_swpcopy(struct memphy_struct *mp, int fpn, int *swptyp)
+{
+   int swpfpn;
+
+   if (fpn < 0 || fpn >= mp->maxsz / PAGING_PAGESZ)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   *swptyp = mp->rmap[fpn].swptyp;
+   swpfpn = mp->rmap[fpn].swpfpn;
+   pthread_mutex_unlock(&mp->fp_lock);
+   return swpfpn;
+}
+
+/*
+*  MEMPHY_take_swpcopy - forget the swap copy of a frame
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @swptyp: returned swap device of the slot
+*  Read and cleared in one go, so only one caller frees the slot.
+*  Return the slot, -1 if none
+*/
+int MEMPHY_take_swpcopy(struct memphy_struct *mp, int fpn, int *swptyp)
+{
+   int swpfpn;
+
+   if (fpn < 0 || fpn >= mp->maxsz / PAGING_PAGESZ)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   *swptyp = mp->rmap[fpn].swptyp;
+   swpfpn = mp->rmap[fpn].swpfpn;
+   mp->rmap[fpn].swpfpn = -1;
+   pthread_mutex_unlock(&mp->fp_lock);
+   return swpfpn;
+}
+
+/*
+*  MEMPHY_get_owner - read the reverse map of a frame
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @pgn: returned page of the owner
+*  Return the owner mm, NULL if the frame is not mapped
+*/
+struct mm_struct *MEMPHY_get_owner(struct memphy_struct *mp, int fpn, int *pgn)
+{
+   struct mm_struct *owner;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   owner = mp->rmap[fpn].owner;
+   *pgn = mp->rmap[fpn].pgn;
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   return owner;
+}
+
+/*
+*  MEMPHY_share - map an owned frame in one more mm, copy on write
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @owner: mm the frame gets mapped in as well
+*  @pgn: page of owner mapped on the frame
+*  Return the new reference count, -1 on error
+*/
+int MEMPHY_share(struct memphy_struct *mp, int fpn, struct mm_struct *owner, int pgn)
+{
+   struct framephy_struct *fp;
+   int refcnt;
+
+   if (fpn < 0 || fpn >= mp->maxsz / PAGING_PAGESZ)
+      return -1;
+
+   fp = malloc(sizeof(struct framephy_struct));
+   if (fp == NULL)
+      return -1;
+   fp->fpn = fpn;
+   fp->owner = owner;
+   fp->pgn = pgn;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   if (mp->rmap[fpn].owner == NULL)
+   {
+      pthread_mutex_unlock(&mp->fp_lock);
+      free(fp);
+      return -1;
+   }
+   fp->fp_next = mp->rmap[fpn].fp_next;
+   mp->rmap[fpn].fp_next = fp;
+   refcnt = ++mp->rmap[fpn].refcnt;
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   return refcnt;
+}
+
+/*
+*  MEMPHY_unshare - drop one mapping of a frame
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @owner: mm that no longer maps the frame
+*  @pgn: page of owner that was mapped on it
+*  When the reverse map entry itself goes, the next sharer takes its
+*  place. Return the mappings left, at 0 the caller frees the frame,
+*  -1 if @owner did not map it
+*/
+int MEMPHY_unshare(struct memphy_struct *mp, int fpn, struct mm_struct *owner, int pgn)
+{
+   struct framephy_struct *head, *fp = NULL, **link;
+   int refcnt = -1;
+
+   if (fpn < 0 || fpn >= mp->maxsz / PAGING_PAGESZ)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   head = &mp->rmap[fpn];
+   if (head->owner == owner && head->pgn == pgn)
+   {
+      fp = head->fp_next;
+      head->owner = (fp != NULL) ? fp->owner : NULL;
+      head->pgn = (fp != NULL) ? fp->pgn : 0;
+      head->fp_next = (fp != NULL) ? fp->fp_next : NULL;
+      refcnt = --head->refcnt;
+   }
+   else
+      for (link = &head->fp_next; *link != NULL; link = &(*link)->fp_next)
+         if ((*link)->owner == owner && (*link)->pgn == pgn)
+         {
+            fp = *link;
+            *link = fp->fp_next;
+            refcnt = --head->refcnt;
+            break;
+         }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   free(fp);
+   return refcnt;
+}
+
+/*
+*  MEMPHY_get_sharer - read one mapping of a frame
+*  @mp: memphy struct
+*  @fpn: frame number
+*  @idx: mapping index, 0 is the reverse map entry itself
+*  @pgn: returned page of the owner
+*  Return the owner mm, NULL past the last mapping
+*/
+struct mm_struct *MEMPHY_get_sharer(struct memphy_struct *mp, int fpn, int idx, int *pgn)
+{
+   struct framephy_struct *fp;
+   struct mm_struct *owner = NULL;
+
+   if (fpn < 0 || fpn >= mp->maxsz / PAGING_PAGESZ)
+      return NULL;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   fp = (mp->rmap[fpn].owner != NULL) ? &mp->rmap[fpn] : NULL;
+   for (; fp != NULL && idx > 0; idx--)
+      fp = fp->fp_next;
+   if (fp != NULL)
+   {
+      owner = fp->owner;
+      *pgn = fp->pgn;
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   return owner;
+}
+
+/*
+*  MEMPHY_drop_owner - clear every reverse map entry naming an mm
+*  @mp: memphy struct
+*  @owner: mm torn down
+*  Only the frames ever handed out are looked at, a debug check run by
+*  free_pcb_memph with VMDBG. Return the entries cleared, each one a
+*  mapping the teardown missed
+*/
+int MEMPHY_drop_owner(struct memphy_struct *mp, struct mm_struct *owner)
+{
+   struct framephy_struct *head, *fp, **link;
+   int fpn, dropped = 0;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   for (fpn = 0; fpn < mp->fp_hwm; fpn++)
+   {
+      head = &mp->rmap[fpn];
+      for (link = &head->fp_next; *link != NULL;)
+         if ((*link)->owner == owner)
+         {
+            fp = *link;
+            *link = fp->fp_next;
+            free(fp);
+            head->refcnt--;
+            dropped++;
+         }
+         else
+            link = &(*link)->fp_next;
+
+      if (head->owner == owner)
+      {
+         fp = head->fp_next;
+         head->owner = (fp != NULL) ? fp->owner : NULL;
+         head->pgn = (fp != NULL) ? fp->pgn : 0;
+         head->fp_next = (fp != NULL) ? fp->fp_next : NULL;
+         head->refcnt = (fp != NULL) ? head->refcnt - 1 : 0;
+         free(fp);
+         dropped++;
+      }
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   return dropped;
+}
+
+/*
+*  MEMPHY_get_refcnt - number of PTEs mapping a frame
+*  @mp: memphy struct
+*  @fpn: frame number
+*/
+int MEMPHY_get_refcnt(struct memphy_struct *mp, int fpn)
+{
+   int refcnt;
+
+   if (fpn < 0 || fpn >= mp->maxsz / PAGING_PAGESZ)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   refcnt = mp->rmap[fpn].refcnt;
+   pthread_mutex_unlock(&mp->fp_lock);
+   return refcnt;
+}
+
+/*
+*  MEMPHY_set_seek_rate - set the seek cost of a sequential device
+*  @mp: memphy struct
+*  @rate: bytes the head crosses per time slot, 0 for free seeks
+*/
+int MEMPHY_set_seek_rate(struct memphy_struct *mp, int rate)
+{
+   if (mp == NULL || rate < 0)
+      return -1;
+
+   mp->seek_rate = rate;
+   return 0;
+}
+
+/*
+*  MEMPHY_map_storage - map the backing store of a device
+*  @mp: memphy struct
+*  @path: host file backing the store, NULL for anonymous
+*
+*  Either way the store is a sparse mapping: a frame costs host memory
+*  only once it is touched, so even a 512MB swap device starts in O(1).
+*  The file is emptied and grown with ftruncate, which leaves it sparse
+*  on disk. Nothing can read a swap slot back in a later run, so the
+*  file is unlinked once mapped and its blocks go when the run ends.
+*/
+static BYTE *MEMPHY_map_storage(struct memphy_struct *mp, const char *path)
+{
+   void *store;
+   int fd;
+
+   if (mp->maxsz <= 0)
+      return calloc(1, 1);
+
+   if (path == NULL)
+      store = mmap(NULL, mp->maxsz, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   else
+   {
+      fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+      if (fd < 0)
+         return NULL;
+      if (ftruncate(fd, mp->maxsz) != 0)
+      {
+         close(fd);
+         return NULL;
+      }
+      store = mmap(NULL, mp->maxsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      unlink(path);
+      close(fd);
+   }
+
+   return (store == MAP_FAILED) ? NULL : store;
+}
+
+/*
+*  init_memphy_file - init a MEMPHY device backed by a host file
+*  @mp: memphy struct
+*  @max_size: device size
+*  @randomflg: random access device when non zero
+*  @path: backing file, NULL for anonymous memory
+*/
+int init_memphy_file(struct memphy_struct *mp, int max_size, int randomflg, const char *path)
 {
-   mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
    mp->maxsz = max_size;
-   memset(mp->storage, 0, max_size * sizeof(BYTE));
+   mp->storage = MEMPHY_map_storage(mp, path);
+   if (mp->storage == NULL)
+   {
+      printf("Cannot map %d bytes of MEMPHY storage%s%s\n", max_size,
+             path ? " on " : "", path ? path : "");
+      return -1;
+   }
+   pthread_mutex_init(&mp->fp_lock, NULL);
 
    MEMPHY_format(mp, PAGING_PAGESZ);
+   /* Zeroed lazily as well, swpfpn is reset by MEMPHY_set_owner before
+    * any frame is used */
+   mp->rmap = calloc(mp->maxsz / PAGING_PAGESZ + 1, sizeof(struct framephy_struct));
+   mp->rmap_hand = 0;
 
    mp->rdmflg = (randomflg != 0) ? 1 : 0;
 
-   if (!mp->rdmflg) /* Not Ramdom acess device, then it serial device*/
-      mp->cursor = 0;
+   /* Not Ramdom acess device, then it serial device, free seeks until
+    * MEMPHY_set_seek_rate gives it a cost */
+   mp->cursor = 0;
+   mp->seek_rate = 0;
 
    return 0;
 }
 
+/*
+*  Init MEMPHY struct
+*/
+int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
+{
+   return init_memphy_file(mp, max_size, randomflg, NULL);
+}
+
 // #endif
\ No newline at end of file
@@ -0,0 +1,447 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Page replacement module mm/mm-pgrep.c
+ *
+ * Every policy keeps the resident pages of one mm on lists threaded
+ * through mm->pgrep.node[] and is driven by three hooks:
+ *    insert - a page became resident (mapped or swapped in)
+ *    access - a resident page was referenced
+ *    victim - pick and unlist the page to swap out
+ *    remove - unlist a page another mm evicted (global replacement)
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define PGREP_NONE -1
+
+/* List roles per policy */
+#define FIFO_Q   0
+#define LRU_INACTIVE 0
+#define LRU_ACTIVE   1
+#define ARC_T1 0
+#define ARC_T2 1
+#define ARC_B1 2
+#define ARC_B2 3
+
+/*
+*  pgrep_node - node of a page, growing the node table to reach it
+*  @st: replacement state
+*  @pgn: page number
+*  Return NULL when the table cannot grow, it is left as it was
+*/
+static struct pgrep_node *pgrep_node(struct pgrep_state *st, int pgn)
+{
+   if (pgn >= st->nnode)
+   {
+      int nnode = st->nnode ? st->nnode : 64;
+      struct pgrep_node *node;
+      int i;
+
+      while (nnode <= pgn)
+         nnode *= 2;
+      node = realloc(st->node, nnode * sizeof(struct pgrep_node));
+      if (node == NULL)
+         return NULL;
+      for (i = st->nnode; i < nnode; i++)
+         node[i].list = PGREP_NONE;
+      st->node = node;
+      st->nnode = nnode;
+   }
+
+   return &st->node[pgn];
+}
+
+static int pgrep_list_of(struct pgrep_state *st, int pgn)
+{
+   return (pgn < st->nnode) ? st->node[pgn].list : PGREP_NONE;
+}
+
+/* The node table already reaches @pgn, pgrep_insert grew it */
+static void pgrep_add_tail(struct pgrep_state *st, int l, int pgn)
+{
+   struct pgrep_node *nd = &st->node[pgn];
+   struct pgrep_list *ls = &st->list[l];
+
+   nd->list = l;
+   nd->next = PGREP_NONE;
+   nd->prev = ls->tail;
+   if (ls->tail != PGREP_NONE)
+      st->node[ls->tail].next = pgn;
+   else
+      ls->head = pgn;
+   ls->tail = pgn;
+   ls->size++;
+}
+
+static void pgrep_del(struct pgrep_state *st, int pgn)
+{
+   struct pgrep_node *nd = &st->node[pgn];
+   struct pgrep_list *ls = &st->list[nd->list];
+
+   if (nd->prev != PGREP_NONE)
+      st->node[nd->prev].next = nd->next;
+   else
+      ls->head = nd->next;
+   if (nd->next != PGREP_NONE)
+      st->node[nd->next].prev = nd->prev;
+   else
+      ls->tail = nd->prev;
+   ls->size--;
+   nd->list = PGREP_NONE;
+}
+
+static int pgrep_pop_head(struct pgrep_state *st, int l)
+{
+   int pgn = st->list[l].head;
+
+   if (pgn != PGREP_NONE)
+      pgrep_del(st, pgn);
+   return pgn;
+}
+
+/* Unlist a resident page, keeping the CLOCK hand on a listed page */
+static void list_remove(struct mm_struct *mm, int pgn)
+{
+   struct pgrep_state *st = &mm->pgrep;
+
+   if (pgrep_list_of(st, pgn) == PGREP_NONE)
+      return;
+   if (st->hand == pgn)
+      st->hand = st->node[pgn].next;
+   pgrep_del(st, pgn);
+}
+
+/*
+*  FIFO - evict the page resident for the longest time
+*/
+static void fifo_insert(struct mm_struct *mm, int pgn)
+{
+   pgrep_add_tail(&mm->pgrep, FIFO_Q, pgn);
+}
+
+static void fifo_access(struct mm_struct *mm, int pgn)
+{
+}
+
+static int fifo_victim(struct mm_struct *mm, int pgn, int *retpgn)
+{
+   *retpgn = pgrep_pop_head(&mm->pgrep, FIFO_Q);
+   return (*retpgn == PGREP_NONE) ? -1 : 0;
+}
+
+/*
+*  CLOCK - second chance on the PTE reference bit, the hand sweeps the
+*  resident pages in load order
+*/
+static void clock_insert(struct mm_struct *mm, int pgn)
+{
+   SETBIT(*pte_ptr(mm, pgn, 0), PAGING_PTE_REF_MASK);
+   pgrep_add_tail(&mm->pgrep, FIFO_Q, pgn);
+}
+
+static void clock_access(struct mm_struct *mm, int pgn)
+{
+   SETBIT(*pte_ptr(mm, pgn, 0), PAGING_PTE_REF_MASK);
+}
+
+static int clock_victim(struct mm_struct *mm, int pgn, int *retpgn)
+{
+   struct pgrep_state *st = &mm->pgrep;
+   int pg = (st->hand != PGREP_NONE) ? st->hand : st->list[FIFO_Q].head;
+   uint32_t *pte;
+
+   if (st->list[FIFO_Q].size == 0)
+      return -1;
+
+   for (;;)
+   {
+      if (pg == PGREP_NONE)
+         pg = st->list[FIFO_Q].head;
+      pte = pte_ptr(mm, pg, 0);
+      if (!(*pte & PAGING_PTE_REF_MASK))
+         break;
+      CLRBIT(*pte, PAGING_PTE_REF_MASK);
+      pg = st->node[pg].next;
+   }
+
+   st->hand = st->node[pg].next;
+   pgrep_del(st, pg);
+   *retpgn = pg;
+   return 0;
+}
+
+/*
+*  LRU approximation - two lists as in Linux. New pages start inactive,
+*  a referenced inactive page is promoted when the victim scan reaches
+*  it and the active list is aged back into the inactive one so that it
+*  never outgrows it. Accesses only set the PTE reference bit
+*/
+static void lru_insert(struct mm_struct *mm, int pgn)
+{
+   CLRBIT(*pte_ptr(mm, pgn, 0), PAGING_PTE_REF_MASK);
+   pgrep_add_tail(&mm->pgrep, LRU_INACTIVE, pgn);
+}
+
+static int lru_victim(struct mm_struct *mm, int pgn, int *retpgn)
+{
+   struct pgrep_state *st = &mm->pgrep;
+   int pg;
+   uint32_t *pte;
+
+   if (st->list[LRU_INACTIVE].size + st->list[LRU_ACTIVE].size == 0)
+      return -1;
+
+   for (;;)
+   {
+      /* Age the active list into the inactive one */
+      while (st->list[LRU_ACTIVE].size > 0 &&
+             (st->list[LRU_INACTIVE].size == 0 ||
+              st->list[LRU_ACTIVE].size > st->list[LRU_INACTIVE].size))
+      {
+         pg = pgrep_pop_head(st, LRU_ACTIVE);
+         CLRBIT(*pte_ptr(mm, pg, 0), PAGING_PTE_REF_MASK);
+         pgrep_add_tail(st, LRU_INACTIVE, pg);
+      }
+
+      pg = pgrep_pop_head(st, LRU_INACTIVE);
+      pte = pte_ptr(mm, pg, 0);
+      if (!(*pte & PAGING_PTE_REF_MASK))
+         break;
+
+      CLRBIT(*pte, PAGING_PTE_REF_MASK);
+      pgrep_add_tail(st, LRU_ACTIVE, pg);
+   }
+
+   *retpgn = pg;
+   return 0;
+}
+
+/*
+*  ARC - adaptive replacement cache (Megiddo & Modha). T1/T2 hold the
+*  resident pages seen once/more than once, B1/B2 remember what was
+*  evicted from them and steer the target size p of T1. The cache size
+*  c is the number of frames the mm currently holds
+*/
+static void arc_trim_ghosts(struct pgrep_state *st)
+{
+   int c = st->list[ARC_T1].size + st->list[ARC_T2].size;
+
+   while (st->list[ARC_B1].size > 0 &&
+          st->list[ARC_T1].size + st->list[ARC_B1].size > c)
+      pgrep_pop_head(st, ARC_B1);
+   while (st->list[ARC_B2].size > 0 &&
+          c + st->list[ARC_B1].size + st->list[ARC_B2].size > 2 * c)
+      pgrep_pop_head(st, ARC_B2);
+}
+
+static void arc_insert(struct mm_struct *mm, int pgn)
+{
+   struct pgrep_state *st = &mm->pgrep;
+   int b1 = st->list[ARC_B1].size, b2 = st->list[ARC_B2].size;
+   int c = st->list[ARC_T1].size + st->list[ARC_T2].size + 1;
+
+   switch (pgrep_list_of(st, pgn))
+   {
+   case ARC_B1: /* T1 was too small */
+      st->arc_p += (b2 > b1) ? b2 / b1 : 1;
+      if (st->arc_p > c)
+         st->arc_p = c;
+      pgrep_del(st, pgn);
+      pgrep_add_tail(st, ARC_T2, pgn);
+      break;
+   case ARC_B2: /* T2 was too small */
+      st->arc_p -= (b1 > b2) ? b1 / b2 : 1;
+      if (st->arc_p < 0)
+         st->arc_p = 0;
+      pgrep_del(st, pgn);
+      pgrep_add_tail(st, ARC_T2, pgn);
+      break;
+   default:
+      pgrep_add_tail(st, ARC_T1, pgn);
+      break;
+   }
+
+   arc_trim_ghosts(st);
+}
+
+static void arc_access(struct mm_struct *mm, int pgn)
+{
+   struct pgrep_state *st = &mm->pgrep;
+   int l = pgrep_list_of(st, pgn);
+
+   if (l == ARC_T1 || l == ARC_T2)
+   {
+      pgrep_del(st, pgn);
+      pgrep_add_tail(st, ARC_T2, pgn);
+   }
+}
+
+static int arc_victim(struct mm_struct *mm, int pgn, int *retpgn)
+{
+   struct pgrep_state *st = &mm->pgrep;
+   int t1 = st->list[ARC_T1].size;
+
+   if (t1 > 0 && (t1 > st->arc_p || st->list[ARC_T2].size == 0 ||
+                  (t1 == st->arc_p && pgrep_list_of(st, pgn) == ARC_B2)))
+   {
+      *retpgn = pgrep_pop_head(st, ARC_T1);
+      pgrep_add_tail(st, ARC_B1, *retpgn);
+   }
+   else if (st->list[ARC_T2].size > 0)
+   {
+      *retpgn = pgrep_pop_head(st, ARC_T2);
+      pgrep_add_tail(st, ARC_B2, *retpgn);
+   }
+   else
+      return -1;
+
+   return 0;
+}
+
+static void arc_remove(struct mm_struct *mm, int pgn)
+{
+   struct pgrep_state *st = &mm->pgrep;
+   int l = pgrep_list_of(st, pgn);
+
+   if (l == ARC_T1 || l == ARC_T2)
+   {
+      pgrep_del(st, pgn);
+      pgrep_add_tail(st, (l == ARC_T1) ? ARC_B1 : ARC_B2, pgn);
+   }
+}
+
+static const struct pgrep_ops pgrep_policies[] = {
+   { "fifo",  fifo_insert,  fifo_access,  fifo_victim,  list_remove },
+   { "clock", clock_insert, clock_access, clock_victim, list_remove },
+   { "lru",   lru_insert,   clock_access, lru_victim,   list_remove },
+   { "arc",   arc_insert,   arc_access,   arc_victim,   arc_remove },
+};
+
+const struct pgrep_ops *mm_pgrep = &pgrep_policies[0];
+int pgrep_global;
+
+/*
+*  pgrep_select - choose the policy of this run by name
+*  @name: fifo, clock, lru or arc
+*/
+int pgrep_select(const char *name)
+{
+   int i;
+
+   for (i = 0; i < sizeof(pgrep_policies) / sizeof(pgrep_policies[0]); i++)
+      if (strcmp(pgrep_policies[i].name, name) == 0)
+      {
+         mm_pgrep = &pgrep_policies[i];
+         return 0;
+      }
+
+   return -1;
+}
+
+/*
+*  pgrep_init - empty replacement state of a new mm
+*  @mm: mm
+*/
+void pgrep_init(struct mm_struct *mm)
+{
+   int l;
+
+   free(mm->pgrep.node);
+   memset(&mm->pgrep, 0, sizeof(struct pgrep_state));
+   for (l = 0; l < PGREP_NLISTS; l++)
+      mm->pgrep.list[l].head = mm->pgrep.list[l].tail = PGREP_NONE;
+   mm->pgrep.hand = PGREP_NONE;
+}
+
+/*
+*  The global clock reads the reference bit whatever the policy is, so
+*  in global mode every reference sets it. Every page made resident
+*  comes through here, this is where the RSS of the mm grows. The node
+*  table is grown first, so the policy hooks never fail. Return -1 when
+*  it cannot grow, the page is then left unlisted and the caller backs
+*  out of the mapping
+*/
+int pgrep_insert(struct mm_struct *mm, int pgn)
+{
+   if (pgrep_node(&mm->pgrep, pgn) == NULL)
+      return -1;
+
+   mm_pgrep->insert(mm, pgn);
+   if (++mm->rss > mm->rss_peak)
+      mm->rss_peak = mm->rss;
+   if (pgrep_global)
+      SETBIT(*pte_ptr(mm, pgn, 0), PAGING_PTE_REF_MASK);
+   return 0;
+}
+
+void pgrep_access(struct mm_struct *mm, int pgn)
+{
+   if (pgrep_global)
+      SETBIT(*pte_ptr(mm, pgn, 0), PAGING_PTE_REF_MASK);
+   mm_pgrep->access(mm, pgn);
+}
+
+/*
+*  pgrep_global_victim - pick a victim among the frames of every mm
+*  @mm: faulting mm, its mm_lock is held by the caller
+*  @mram: RAM device
+*  @vicmm: returned owner of the victim page
+*  @vicpgn: returned victim page of vicmm
+*
+*  A clock hand sweeps the RAM frames through the reverse map and gives
+*  every referenced page a second chance. Another mm is only taken with
+*  trylock, so two faulting CPUs can never deadlock, and its mapping is
+*  revalidated once locked. On success the victim is unlisted from its
+*  owner policy and, when vicmm is not mm, vicmm stays locked until the
+*  caller has swapped the page out. Return -1 if two sweeps found none
+*/
+int pgrep_global_victim(struct mm_struct *mm, struct memphy_struct *mram,
+                        struct mm_struct **vicmm, int *vicpgn)
+{
+   int nfp = mram->maxsz / PAGING_PAGESZ;
+   int step, fpn, pgn;
+   struct mm_struct *owner;
+
+   for (step = 0; step < 2 * nfp; step++)
+   {
+      pthread_mutex_lock(&mram->fp_lock);
+      fpn = mram->rmap_hand;
+      mram->rmap_hand = (fpn + 1) % nfp;
+      pthread_mutex_unlock(&mram->fp_lock);
+
+      owner = MEMPHY_get_owner(mram, fpn, &pgn);
+      if (owner == NULL)
+         continue;
+      if (owner != mm && pthread_mutex_trylock(&owner->mm_lock) != 0)
+         continue;
+
+      uint32_t *pte = pte_ptr(owner, pgn, 0);
+
+      if (mram->rmap[fpn].owner != owner || mram->rmap[fpn].pgn != pgn || pte == NULL ||
+          !PAGING_PAGE_PRESENT(*pte) || PAGING_PTE_FPN(*pte) != fpn ||
+          (*pte & PAGING_PTE_REF_MASK))
+      {
+         if (mram->rmap[fpn].owner == owner && pte != NULL && PAGING_PAGE_PRESENT(*pte) &&
+             PAGING_PTE_FPN(*pte) == fpn)
+            CLRBIT(*pte, PAGING_PTE_REF_MASK); /* second chance, a stale rmap entry may
+                                                * name a swapped PTE */
+         if (owner != mm)
+            pthread_mutex_unlock(&owner->mm_lock);
+         continue;
+      }
+
+      mm_pgrep->remove(owner, pgn);
+      *vicmm = owner;
+      *vicpgn = pgn;
+      return 0;
+   }
+
+   return -1;
+}
+
+// #endif
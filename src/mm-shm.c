@@ -0,0 +1,289 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Shared memory module mm/mm-shm.c
+ *
+ * A segment is named by a key, the first process attaching it gives its
+ * size. An attachment reserves whole pages at the break of vma0, their
+ * PTEs carry PAGING_PTE_SHM_MASK and fault in through the segment: the
+ * segment keeps one PTE of its own per page, the frame while some
+ * attacher maps it, the swap slot once none does. Every attacher maps
+ * the same frame, chained as a sharer in the memphy rmap like COW pages
+ * but never copied on write. A segment is freed, its frames and slots
+ * with it, when its last attacher detaches.
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+static struct shm_seg *shm_segs;
+static pthread_mutex_t shm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+*  shm_get - look a segment up by key and attach to it, create it if it
+*  does not exist
+*  @key: segment name
+*  @size: bytes wanted, 0 for the whole of an existing segment
+*  The attach is counted right away, so a detach racing with it can not
+*  free the segment. Return NULL if the segment is smaller than @size or
+*  cannot be created
+*/
+static struct shm_seg *shm_get(int key, int size)
+{
+   struct shm_seg *seg;
+   int npages = DIV_ROUND_UP(size, PAGING_PAGESZ);
+
+   pthread_mutex_lock(&shm_lock);
+   for (seg = shm_segs; seg != NULL; seg = seg->next)
+      if (seg->key == key)
+         break;
+
+   if (seg == NULL && npages > 0 && (seg = malloc(sizeof(struct shm_seg))) != NULL)
+   {
+      seg->page = calloc(npages, sizeof(uint32_t));
+      if (seg->page == NULL)
+      {
+         free(seg);
+         seg = NULL;
+      }
+      else
+      {
+         seg->key = key;
+         seg->npages = npages;
+         seg->nattach = 0;
+         pthread_mutex_init(&seg->lock, NULL);
+         seg->next = shm_segs;
+         shm_segs = seg;
+      }
+   }
+   else if (seg != NULL && npages > seg->npages)
+      seg = NULL;
+   if (seg != NULL)
+      seg->nattach++;
+   pthread_mutex_unlock(&shm_lock);
+
+   return seg;
+}
+
+/*
+*  shm_put - drop an attach of a segment, free it with the last one
+*  @caller: process
+*  @seg: segment, its lock is not held
+*  No attacher maps a page any more by then, the frames and swap slots
+*  the segment still holds go back to their devices
+*/
+static void shm_put(struct pcb_t *caller, struct shm_seg *seg)
+{
+   struct shm_seg **link;
+   int i;
+
+   pthread_mutex_lock(&shm_lock);
+   if (--seg->nattach > 0)
+   {
+      pthread_mutex_unlock(&shm_lock);
+      return;
+   }
+   for (link = &shm_segs; *link != seg; link = &(*link)->next)
+      ;
+   *link = seg->next;
+   pthread_mutex_unlock(&shm_lock);
+
+   for (i = 0; i < seg->npages; i++)
+      if (PAGING_PAGE_PRESENT(seg->page[i]))
+         MEMPHY_put_freefp(caller->mram, PAGING_PTE_FPN(seg->page[i]));
+      else if (PAGING_PAGE_SWAPPED(seg->page[i]))
+         swp_free(caller, PAGING_PTE_SWPTYP(seg->page[i]), PAGING_PTE_SWP(seg->page[i]));
+
+   pthread_mutex_destroy(&seg->lock);
+   free(seg->page);
+   free(seg);
+   MM_STAT_INC(shm_destroy);
+}
+
+/*
+*  shm_attach - map a segment in a region of vma0, shmat
+*  @caller: process
+*  @key: segment name
+*  @size: bytes to map, the segment is created this large
+*  @rgid: region the segment is reachable through
+*  The region takes whole pages at the break, no page is touched: the
+*  first access of every attacher faults the frame in
+*/
+int shm_attach(struct pcb_t *caller, int key, int size, int rgid)
+{
+   struct mm_struct *mm = caller->mm;
+   struct vm_area_struct *vma;
+   struct vm_shm_struct *att;
+   struct shm_seg *seg;
+   int i, pgn, npages;
+
+   if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ || size < 0)
+      return -1;
+
+   seg = shm_get(key, size);
+   if (seg == NULL)
+      return -1;
+   npages = (size > 0) ? DIV_ROUND_UP(size, PAGING_PAGESZ) : seg->npages;
+
+   att = malloc(sizeof(struct vm_shm_struct));
+   if (att == NULL)
+   {
+      shm_put(caller, seg);
+      return -1;
+   }
+
+   pthread_mutex_lock(&mm->mm_lock);
+   vma = get_vma_by_num(mm, 0);
+   pgn = PAGING_PGN(vma->sbrk);
+   for (i = 0; i < npages; i++)
+      if (pgn + i >= PAGING_MAX_PGN || pte_map(mm, pgn + i) == NULL)
+      {
+         pthread_mutex_unlock(&mm->mm_lock);
+         free(att);
+         shm_put(caller, seg);
+         return -1;
+      }
+
+   /* The break is page aligned, the region is kept off the free list
+    * while attached, a detach hands it back as plain pages */
+   vma->vm_end += npages * PAGING_PAGESZ;
+   vma->sbrk += npages * PAGING_PAGESZ;
+   for (i = 0; i < npages; i++)
+      *pte_ptr(mm, pgn + i, 0) = PAGING_PTE_SHM_MASK;
+
+   mm->symrgtbl[rgid].rg_start = pgn * PAGING_PAGESZ;
+   mm->symrgtbl[rgid].rg_end = (pgn + npages) * PAGING_PAGESZ;
+
+   att->seg = seg;
+   att->pgn = pgn;
+   att->npages = npages;
+   att->next = mm->shm;
+   mm->shm = att;
+   pthread_mutex_unlock(&mm->mm_lock);
+
+   MM_STAT_INC(shm_attach);
+   return 0;
+}
+
+/*
+*  shm_find - segment page behind a page of an mm
+*  @mm: attacher, its mm_lock is held
+*  @pgn: page
+*  @idx: returned page of the segment
+*/
+struct shm_seg *shm_find(struct mm_struct *mm, int pgn, int *idx)
+{
+   struct vm_shm_struct *att;
+
+   for (att = mm->shm; att != NULL; att = att->next)
+      if (pgn >= att->pgn && pgn < att->pgn + att->npages)
+      {
+         *idx = pgn - att->pgn;
+         return att->seg;
+      }
+
+   return NULL;
+}
+
+/*
+*  shm_writeback - put a segment page no attacher maps any more to swap
+*  @caller: process, its mm_lock is held
+*  @seg: segment, its lock is held
+*  @idx: page of the segment
+*  @fpn: frame of the page
+*  Without a free slot the frame stays with the segment, unmapped, the
+*  next attacher faulting on the page takes it back
+*/
+static void shm_writeback(struct pcb_t *caller, struct shm_seg *seg, int idx, int fpn)
+{
+   int swptyp, swpoff, slots;
+
+   if (swp_alloc(caller, &swptyp, &swpoff) != 0)
+      return;
+
+   slots = __swap_cp_page(caller->mram, fpn, swp_dev(caller, swptyp), swpoff);
+   if (slots > 0)
+      caller->stall += slots;
+   pte_set_swap(&seg->page[idx], swptyp, swpoff);
+   MEMPHY_put_freefp(caller->mram, fpn);
+   MM_STAT_INC(swp_out[swptyp]);
+   MM_STAT_INC(pg_writeback);
+}
+
+/*
+*  shm_detach - unmap the segment attached at a region, shmdt
+*  @caller: process, its mm_lock is held
+*  @start: region start
+*  The pages go back to plain never touched PTEs, the caller puts the
+*  region on the free list. Return -1 if no segment is attached at @start
+*/
+int shm_detach(struct pcb_t *caller, unsigned long start)
+{
+   struct mm_struct *mm = caller->mm;
+   struct vm_shm_struct *att, **link;
+   int i, pgn, fpn;
+   uint32_t *pte;
+
+   for (link = &mm->shm; *link != NULL; link = &(*link)->next)
+      if ((*link)->pgn * PAGING_PAGESZ == start)
+         break;
+   if (*link == NULL)
+      return -1;
+
+   att = *link;
+   pthread_mutex_lock(&att->seg->lock);
+   for (i = 0; i < att->npages; i++)
+   {
+      pgn = att->pgn + i;
+      pte = pte_ptr(mm, pgn, 0);
+      if (pte == NULL)
+         continue; /* a failed fork did not get that far */
+      if (PAGING_PAGE_PRESENT(*pte))
+      {
+         fpn = PAGING_PTE_FPN(*pte);
+         tlb_flush_page(mm, pgn);
+         mm_pgrep->remove(mm, pgn);
+         mm->rss--;
+         if (MEMPHY_unshare(caller->mram, fpn, mm, pgn) == 0)
+            shm_writeback(caller, att->seg, i, fpn);
+      }
+      *pte = 0;
+   }
+   pthread_mutex_unlock(&att->seg->lock);
+
+   *link = att->next;
+   shm_put(caller, att->seg);
+   free(att);
+   return 0;
+}
+
+/*
+*  shm_fork - attach the segments of a parent to its forked child
+*  @mm: parent
+*  @cmm: child, both mm_lock are held
+*  The PTEs themselves are copied by fork_pcb_memph
+*/
+int shm_fork(struct mm_struct *mm, struct mm_struct *cmm)
+{
+   struct vm_shm_struct *att, *catt;
+
+   for (att = mm->shm; att != NULL; att = att->next)
+   {
+      catt = malloc(sizeof(struct vm_shm_struct));
+      if (catt == NULL)
+         return -1;
+      *catt = *att;
+      catt->next = cmm->shm;
+      cmm->shm = catt;
+
+      pthread_mutex_lock(&shm_lock);
+      att->seg->nattach++;
+      pthread_mutex_unlock(&shm_lock);
+   }
+
+   return 0;
+}
+
+// #endif
@@ -0,0 +1,127 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Memory statistics module mm/mm-stats.c
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <time.h>
+
+struct mm_stats mmstats;
+
+/*
+*  mm_stats_now - monotonic clock in nanoseconds
+*/
+uint64_t mm_stats_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+*  mm_stats_alloc_done - account one __alloc call
+*  @ns: time spent in it
+*/
+void mm_stats_alloc_done(uint64_t ns)
+{
+   uint64_t max = __atomic_load_n(&mmstats.alloc_max_ns, __ATOMIC_RELAXED);
+
+   MM_STAT_INC(alloc_cnt);
+   MM_STAT_ADD(alloc_ns, ns);
+   while (ns > max &&
+          !__atomic_compare_exchange_n(&mmstats.alloc_max_ns, &max, ns, 0,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      ;
+}
+
+/*
+*  mm_stats_dump - print the counters, called once every CPU stopped
+*  @mram: RAM device, for its frame usage
+*/
+void mm_stats_dump(struct memphy_struct *mram)
+{
+   struct mm_stats *st = &mmstats;
+   int i;
+
+   printf("===== MM STATISTICS =====\n");
+   printf("alloc: %llu calls, %llu grew the area, avg %llu ns, max %llu ns\n",
+          (unsigned long long)st->alloc_cnt,
+          (unsigned long long)st->alloc_brk_cnt,
+          (unsigned long long)(st->alloc_cnt ? st->alloc_ns / st->alloc_cnt : 0),
+          (unsigned long long)st->alloc_max_ns);
+   printf("free: %llu calls, %llu neighbour merges\n",
+          (unsigned long long)st->free_cnt,
+          (unsigned long long)st->coalesce_cnt);
+   printf("fragmentation: avg %llu.%llu%% over %llu allocs\n",
+          (unsigned long long)(st->frag_samples ? st->frag_permille / st->frag_samples / 10 : 0),
+          (unsigned long long)(st->frag_samples ? st->frag_permille / st->frag_samples % 10 : 0),
+          (unsigned long long)st->frag_samples);
+   printf("tlb: %llu hits, %llu misses, hit rate %llu%%, %llu hits on large pages\n",
+          (unsigned long long)st->tlb_hit,
+          (unsigned long long)st->tlb_miss,
+          (unsigned long long)(st->tlb_hit + st->tlb_miss ?
+                               st->tlb_hit * 100 / (st->tlb_hit + st->tlb_miss) : 0),
+          (unsigned long long)st->tlb_lhit);
+   printf("paging: policy %s, %llu accesses, %llu faults (%llu.%llu%%), %llu evictions\n",
+          mm_pgrep->name,
+          (unsigned long long)st->pg_access,
+          (unsigned long long)st->pg_fault,
+          (unsigned long long)(st->pg_access ? st->pg_fault * 100 / st->pg_access : 0),
+          (unsigned long long)(st->pg_access ? st->pg_fault * 1000 / st->pg_access % 10 : 0),
+          (unsigned long long)st->pg_evict);
+   printf("page tables: %llu page table pages, %llu KB\n",
+          (unsigned long long)st->pgt_alloc,
+          (unsigned long long)(st->pgt_alloc * PAGING_PGT_NENT * sizeof(uint32_t) / 1024));
+   printf("pages: %d bytes, large pages %s, %llu mapped, %llu blocks split for lack of a frame run\n",
+          PAGING_PAGESZ, mm_lpage ? "on" : "off",
+          (unsigned long long)st->lpage_map,
+          (unsigned long long)st->lpage_split);
+   printf("ram: %s paging, %d frames, %d used at peak, %llu zero-filled on first touch\n",
+          mm_demand ? "demand" : "eager",
+          mram->numfp, mram->numfp - mram->nfree_low,
+          (unsigned long long)st->pg_zerofill);
+   printf("swap: %s replacement, %llu pages out, %llu pages in, %llu taken from other processes\n",
+          pgrep_global ? "global" : "local",
+          (unsigned long long)st->pg_evict,
+          (unsigned long long)st->pg_swapin,
+          (unsigned long long)st->pg_evict_other);
+   printf("read-ahead: window up to %d pages, %llu pages read, %llu used (%llu%%), %llu evicted unused, %llu%% of swap-in faults saved\n",
+          mm_readahead,
+          (unsigned long long)st->ra_page,
+          (unsigned long long)st->ra_hit,
+          (unsigned long long)(st->ra_page ? st->ra_hit * 100 / st->ra_page : 0),
+          (unsigned long long)st->ra_miss,
+          /* swap-in faults there would have been without read-ahead */
+          (unsigned long long)(st->pg_swapin - st->ra_page + st->ra_hit ?
+                               st->ra_hit * 100 / (st->pg_swapin - st->ra_page + st->ra_hit) : 0));
+   printf("rss: %llu faults at the limit replaced within the working set\n",
+          (unsigned long long)st->rss_evict);
+   printf("swap devices: %s placement, pages placed", swp_mode_name());
+   for (i = 0; i < PAGING_MAX_MMSWP; i++)
+      printf(" %llu", (unsigned long long)st->swp_out[i]);
+   printf(", %llu demoted\n", (unsigned long long)st->swp_demote);
+   printf("fork: %llu forks, %llu frames shared copy on write, %llu copied on first write\n",
+          (unsigned long long)st->fork_cnt,
+          (unsigned long long)st->fork_shared,
+          (unsigned long long)st->pg_cow);
+   printf("teardown: %llu processes, %llu mapped pages released, %d frames in use at exit\n",
+          (unsigned long long)st->mm_teardown,
+          (unsigned long long)st->pg_teardown,
+          mram->numfp - mram->nfree);
+   printf("shm: %llu attaches, %llu faults mapped a resident segment frame, %llu segments freed\n",
+          (unsigned long long)st->shm_attach,
+          (unsigned long long)st->shm_hit,
+          (unsigned long long)st->shm_destroy);
+   printf("write-back: %llu pages copied, %llu clean pages skipped\n",
+          (unsigned long long)st->pg_writeback,
+          (unsigned long long)st->pg_wb_clean);
+   printf("seek: %llu bytes crossed on sequential devices, %llu slots of latency\n",
+          (unsigned long long)st->dev_seek_bytes,
+          (unsigned long long)st->dev_seek_slots);
+   printf("===== MM STATISTICS END =====\n");
+}
+
+// #endif
@@ -0,0 +1,215 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Swap placement module mm/mm-swap.c
+ *
+ * Every configured MEMSWP device takes swapped pages, the PTE records
+ * which one in its SWPTYP bits. The placement mode picks the device:
+ *    stripe - round robin over the devices that still have a free slot
+ *    least  - the device with the most free slots
+ *    tier   - device 0 is a small fast tier holding the pages swapped
+ *             out last, when it is full its oldest slot is demoted to
+ *             the next larger, slower device
+ * The rmap of a swap device records the mm and pgn behind every slot.
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+static const char *swp_mode_names[] = {
+   [SWP_STRIPE] = "stripe",
+   [SWP_LEAST] = "least",
+   [SWP_TIER] = "tier",
+};
+
+int swp_mode = SWP_STRIPE;
+static unsigned int swp_next; /* stripe cursor */
+
+/*
+*  swp_select - choose the placement mode of this run by name
+*  @name: stripe, least or tier
+*/
+int swp_select(const char *name)
+{
+   int i;
+
+   for (i = 0; i < sizeof(swp_mode_names) / sizeof(swp_mode_names[0]); i++)
+      if (strcmp(swp_mode_names[i], name) == 0)
+      {
+         swp_mode = i;
+         return 0;
+      }
+
+   return -1;
+}
+
+const char *swp_mode_name(void)
+{
+   return swp_mode_names[swp_mode];
+}
+
+/*
+*  swp_dev - swap device of a swap type
+*  @caller: process
+*  @swptyp: PTE swap type
+*/
+struct memphy_struct *swp_dev(struct pcb_t *caller, int swptyp)
+{
+   return caller->cold->mswp[swptyp];
+}
+
+/*
+*  swp_take - take a slot on a device
+*/
+static int swp_take(struct pcb_t *caller, int swptyp, int *swpoff)
+{
+   return MEMPHY_get_freefp(swp_dev(caller, swptyp), swpoff);
+}
+
+/*
+*  swp_take_from - take a slot on the first device from @swptyp on
+*/
+static int swp_take_from(struct pcb_t *caller, int swptyp, int *rettyp, int *swpoff)
+{
+   for (; swptyp < PAGING_MAX_MMSWP; swptyp++)
+      if (swp_take(caller, swptyp, swpoff) == 0)
+      {
+         *rettyp = swptyp;
+         return 0;
+      }
+
+   return -1;
+}
+
+/*
+*  swp_demote - move the oldest slot of a tier down to a slower device
+*  @caller: faulting process, its mm_lock is held
+*  @swptyp: tier to make room in
+*
+*  A hand sweeps the tier rmap. The owner mm of a slot is taken with
+*  trylock and its PTE revalidated, as the global replacement clock
+*  does. A swapped page is copied to the first lower tier with room, a
+*  clean copy kept for a resident page is simply dropped.
+*  Return 0 once a slot of the tier was freed
+*/
+static int swp_demote(struct pcb_t *caller, int swptyp)
+{
+   struct memphy_struct *mp = swp_dev(caller, swptyp);
+   struct mm_struct *owner;
+   int step, off, pgn, newtyp, newoff, cpytyp;
+   int ret = -1;
+
+   for (step = 0; step < mp->numfp && ret != 0; step++)
+   {
+      pthread_mutex_lock(&mp->fp_lock);
+      off = mp->rmap_hand;
+      mp->rmap_hand = (off + 1) % mp->numfp;
+      pthread_mutex_unlock(&mp->fp_lock);
+
+      owner = MEMPHY_get_owner(mp, off, &pgn);
+      if (owner == NULL)
+         continue;
+      if (owner != caller->mm && pthread_mutex_trylock(&owner->mm_lock) != 0)
+         continue;
+
+      uint32_t pte = pte_get(owner, pgn);
+
+      if (mp->rmap[off].owner != owner || mp->rmap[off].pgn != pgn)
+         ;  /* slot changed hands meanwhile */
+      else if (PAGING_PAGE_PRESENT(pte))
+      {
+         if (MEMPHY_get_swpcopy(caller->mram, PAGING_PTE_FPN(pte), &cpytyp) == off &&
+             cpytyp == swptyp)
+         {
+            MEMPHY_set_swpcopy(caller->mram, PAGING_PTE_FPN(pte), 0, -1);
+            swp_free(caller, swptyp, off);
+            ret = 0;
+         }
+      }
+      else if (PAGING_PAGE_SWAPPED(pte) &&
+               PAGING_PTE_SWPTYP(pte) == swptyp &&
+               PAGING_PTE_SWP(pte) == off &&
+               swp_take_from(caller, swptyp + 1, &newtyp, &newoff) == 0)
+      {
+         int slots = MEMPHY_copy_frames(mp, off, swp_dev(caller, newtyp), newoff, 1);
+         if (slots > 0)
+            caller->stall += slots;
+         pte_set_swap(pte_ptr(owner, pgn, 0), newtyp, newoff);
+         MEMPHY_set_owner(swp_dev(caller, newtyp), newoff, owner, pgn);
+         swp_free(caller, swptyp, off);
+         MM_STAT_INC(swp_out[newtyp]);
+         MM_STAT_INC(swp_demote);
+         ret = 0;
+      }
+
+      if (owner != caller->mm)
+         pthread_mutex_unlock(&owner->mm_lock);
+   }
+
+   return ret;
+}
+
+/*
+*  swp_alloc - reserve a swap slot for a page going out
+*  @caller: faulting process, its mm_lock is held
+*  @swptyp: returned device
+*  @swpoff: returned slot on that device
+*/
+int swp_alloc(struct pcb_t *caller, int *swptyp, int *swpoff)
+{
+   int i, typ, best = -1;
+
+   switch (swp_mode)
+   {
+   case SWP_LEAST:
+      for (typ = 0; typ < PAGING_MAX_MMSWP; typ++)
+         if (best < 0 || swp_dev(caller, typ)->nfree > swp_dev(caller, best)->nfree)
+            best = typ;
+      if (swp_take(caller, best, swpoff) == 0)
+      {
+         *swptyp = best;
+         return 0;
+      }
+      break; /* raced to full, take any */
+
+   case SWP_TIER:
+      if (swp_take(caller, 0, swpoff) == 0 ||
+          (swp_demote(caller, 0) == 0 && swp_take(caller, 0, swpoff) == 0))
+      {
+         *swptyp = 0;
+         return 0;
+      }
+      break;
+
+   default:
+      typ = __atomic_fetch_add(&swp_next, 1, __ATOMIC_RELAXED);
+      for (i = 0; i < PAGING_MAX_MMSWP; i++)
+         if (swp_take(caller, (typ + i) % PAGING_MAX_MMSWP, swpoff) == 0)
+         {
+            *swptyp = (typ + i) % PAGING_MAX_MMSWP;
+            return 0;
+         }
+      return -1;
+   }
+
+   return swp_take_from(caller, 0, swptyp, swpoff);
+}
+
+/*
+*  swp_free - give a swap slot back
+*  @caller: process
+*  @swptyp: device
+*  @swpoff: slot
+*/
+void swp_free(struct pcb_t *caller, int swptyp, int swpoff)
+{
+   struct memphy_struct *mp = swp_dev(caller, swptyp);
+
+   MEMPHY_set_owner(mp, swpoff, NULL, 0);
+   MEMPHY_put_freefp(mp, swpoff);
+}
+
+// #endif
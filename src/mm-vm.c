@@ -36,9 +36,9 @@ struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid)
   return pvma;
 }
 
-int __mm_swap_page(struct pcb_t *caller, int vicfpn, int swpfpn)
+int __mm_swap_page(struct pcb_t *caller, int vicfpn, int swptyp, int swpfpn)
 {
-  if (caller == NULL || caller->mram == NULL || caller->active_mswp == NULL)
+  if (caller == NULL || caller->mram == NULL || swptyp >= PAGING_MAX_MMSWP)
   {
     return -1;
   }
@@ -46,7 +46,11 @@ int __mm_swap_page(struct pcb_t *caller, int vicfpn, int swpfpn)
   {
     return -1;
   }
-  __swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
+  /* The faulting process waits for a sequential swap device to seek */
+  int slots = __swap_cp_page(caller->mram, vicfpn, swp_dev(caller, swptyp), swpfpn);
+  if (slots < 0)
+    return -1;
+  caller->stall += slots;
   return 0;
 }
 
@@ -110,11 +114,71 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int
   return 0;
 }
 
+int mm_demand;
+int mm_lpage;
+
+/*vm_map_lpages - map the growth of a vm area, large pages where aligned
+*@caller: caller
+*@start: first byte of the growth, page aligned
+*@npages: pages of the growth
+*@ret_rg: returned region
+*
+* Every aligned block of PAGING_LPAGE_NR pages the growth covers is
+* marked as a large page, pg_lmap maps it now or on its first touch in
+* demand paging mode. The pages around the blocks, and the blocks no
+* frame run was free for, are mapped page by page
+*/
+static int vm_map_lpages(struct pcb_t *caller, int start, int npages, struct vm_rg_struct *ret_rg)
+{
+  int pgn = PAGING_PGN(start);
+  int end = pgn + npages;
+  int lpgn = (pgn + PAGING_LPAGE_NR - 1) & ~(PAGING_LPAGE_NR - 1);
+  int lend = end & ~(PAGING_LPAGE_NR - 1);
+  int i, next;
+  uint32_t *pte;
+
+  if (lpgn >= lend)
+    lpgn = lend = end; /* no whole block */
+
+  for (i = lpgn; i < lend; i++)
+  {
+    if ((pte = pte_map(caller->mm, i)) == NULL)
+      return -1;
+    SETBIT(*pte, PAGING_PTE_LARGE_MASK);
+  }
+
+  if (mm_demand)
+    return 0;
+
+  for (i = pgn; i < end; i = next)
+  {
+    if (i < lpgn)
+      next = lpgn;
+    else if (i < lend)
+    {
+      next = i + PAGING_LPAGE_NR;
+      if (pg_lmap(caller->mm, i, caller) == 0)
+        continue;
+    }
+    else
+      next = end;
+
+    if (vm_map_ram(caller, start, start + npages * PAGING_PAGESZ,
+                   i * PAGING_PAGESZ, next - i, ret_rg) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
 /*inc_vma_limit - increase vm area limits to reserve space for new variable
 *@caller: caller
 *@vmaid: ID vm area to alloc memory region
 *@inc_sz: increment size
 *
+* In demand paging mode only the virtual space is reserved, pg_getpage
+* gives every page a zeroed frame on its first touch. With large pages
+* the growth goes through vm_map_lpages
 */
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
 {
@@ -155,10 +219,12 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
   struct vm_rg_struct *inc_rg = malloc(sizeof(struct vm_rg_struct));
   inc_rg->rg_start = old_end;
   inc_rg->rg_end = cur_vma->vm_end;
-  inc_rg->rg_next = NULL;
   enlist_vm_freerg_list(caller->mm, inc_rg);
   
-  if (vm_map_ram(caller, area->rg_start, area->rg_end,
+  if (mm_lpage)
+    return vm_map_lpages(caller, old_end, incnumpage, newrg);
+
+  if (!mm_demand && vm_map_ram(caller, area->rg_start, area->rg_end,
                 old_end, incnumpage, newrg) < 0)
   {
     return -1; /* Map the memory to MEMRAM */
@@ -167,4 +233,254 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
   return 0;
 }
 
-// #endif
\ No newline at end of file
+/*vm_freerg_hash - bucket of a region boundary in by_start/by_end
+*@addr: region start or end
+*
+*/
+static inline uint32_t vm_freerg_hash(unsigned long addr)
+{
+  return ((uint32_t)addr * 2654435761u) >> (32 - VM_FREERG_HASHBITS);
+}
+
+/*vm_freerg_class - size class of a region length
+*@sz: region length, not 0
+*
+*/
+static inline int vm_freerg_class(unsigned long sz)
+{
+  int cls = 31 - __builtin_clz((uint32_t)sz);
+
+  return (cls < VM_FREERG_NBINS) ? cls : VM_FREERG_NBINS - 1;
+}
+
+/*vm_freerg_link - put a free region in its bin and boundary buckets
+*@fb: free region bins
+*@rg: region
+*
+*/
+static void vm_freerg_link(struct vm_freerg_bins *fb, struct vm_rg_struct *rg)
+{
+  int cls = vm_freerg_class(rg->rg_end - rg->rg_start);
+  uint32_t hs = vm_freerg_hash(rg->rg_start);
+  uint32_t he = vm_freerg_hash(rg->rg_end);
+
+  rg->rg_prev = NULL;
+  rg->rg_next = fb->bin[cls];
+  if (rg->rg_next)
+    rg->rg_next->rg_prev = rg;
+  fb->bin[cls] = rg;
+  fb->bitmap |= BIT(cls);
+
+  rg->rg_hstart = fb->by_start[hs];
+  fb->by_start[hs] = rg;
+  rg->rg_hend = fb->by_end[he];
+  fb->by_end[he] = rg;
+
+  fb->free_bytes += rg->rg_end - rg->rg_start;
+  fb->nfree++;
+}
+
+/*vm_freerg_unlink - take a free region out of its bin and buckets
+*@fb: free region bins
+*@rg: region
+*
+*/
+static void vm_freerg_unlink(struct vm_freerg_bins *fb, struct vm_rg_struct *rg)
+{
+  int cls = vm_freerg_class(rg->rg_end - rg->rg_start);
+  struct vm_rg_struct **pp;
+
+  if (rg->rg_prev)
+    rg->rg_prev->rg_next = rg->rg_next;
+  else
+    fb->bin[cls] = rg->rg_next;
+  if (rg->rg_next)
+    rg->rg_next->rg_prev = rg->rg_prev;
+  if (fb->bin[cls] == NULL)
+    fb->bitmap &= ~BIT(cls);
+
+  for (pp = &fb->by_start[vm_freerg_hash(rg->rg_start)]; *pp != rg; pp = &(*pp)->rg_hstart)
+    ;
+  *pp = rg->rg_hstart;
+  for (pp = &fb->by_end[vm_freerg_hash(rg->rg_end)]; *pp != rg; pp = &(*pp)->rg_hend)
+    ;
+  *pp = rg->rg_hend;
+
+  rg->rg_next = rg->rg_prev = NULL;
+  fb->free_bytes -= rg->rg_end - rg->rg_start;
+  fb->nfree--;
+}
+
+/*vm_freerg_ending_at - free region whose end is @addr, NULL if none
+*@fb: free region bins
+*@addr: address
+*
+*/
+static struct vm_rg_struct *vm_freerg_ending_at(struct vm_freerg_bins *fb, unsigned long addr)
+{
+  struct vm_rg_struct *rg = fb->by_end[vm_freerg_hash(addr)];
+
+  while (rg != NULL && rg->rg_end != addr)
+    rg = rg->rg_hend;
+
+  return rg;
+}
+
+/*vm_freerg_starting_at - free region whose start is @addr, NULL if none
+*@fb: free region bins
+*@addr: address
+*
+*/
+static struct vm_rg_struct *vm_freerg_starting_at(struct vm_freerg_bins *fb, unsigned long addr)
+{
+  struct vm_rg_struct *rg = fb->by_start[vm_freerg_hash(addr)];
+
+  while (rg != NULL && rg->rg_start != addr)
+    rg = rg->rg_hstart;
+
+  return rg;
+}
+
+/*vm_freerg_init - empty free region bins
+*@fb: free region bins
+*
+*/
+void vm_freerg_init(struct vm_freerg_bins *fb)
+{
+  memset(fb, 0, sizeof(struct vm_freerg_bins));
+}
+
+/*vm_freerg_clear - free every region left in the bins
+*@fb: free region bins
+*
+*/
+void vm_freerg_clear(struct vm_freerg_bins *fb)
+{
+  struct vm_rg_struct *rg;
+  int i;
+
+  for (i = 0; i < VM_FREERG_NBINS; i++)
+    while ((rg = fb->bin[i]) != NULL)
+    {
+      fb->bin[i] = rg->rg_next;
+      free(rg);
+    }
+
+  vm_freerg_init(fb);
+}
+
+/*vm_freerg_insert - give a region back, merging it with free neighbours
+*@fb: free region bins
+*@rg: region, owned by the bins from now on
+*
+*/
+int vm_freerg_insert(struct vm_freerg_bins *fb, struct vm_rg_struct *rg)
+{
+  struct vm_rg_struct *nb;
+
+  if (rg->rg_start >= rg->rg_end)
+  {
+    free(rg);
+    return -1;
+  }
+
+  if ((nb = vm_freerg_ending_at(fb, rg->rg_start)) != NULL)
+  {
+    vm_freerg_unlink(fb, nb);
+    rg->rg_start = nb->rg_start;
+    free(nb);
+    MM_STAT_INC(coalesce_cnt);
+  }
+
+  if ((nb = vm_freerg_starting_at(fb, rg->rg_end)) != NULL)
+  {
+    vm_freerg_unlink(fb, nb);
+    rg->rg_end = nb->rg_end;
+    free(nb);
+    MM_STAT_INC(coalesce_cnt);
+  }
+
+  vm_freerg_link(fb, rg);
+  return 0;
+}
+
+/*vm_freerg_take - carve @size bytes out of a free region, segregated fit
+*@fb: free region bins
+*@size: requested size
+*@newrg: returned region
+*
+*Only the size class of @size may hold regions that are too small, so it
+*is walked for the first region that fits. Otherwise any region of the
+*next non empty class fits and its head is used. The cost is O(1) for
+*the bitmap lookup plus O(k) for the k regions of the class of @size
+*/
+int vm_freerg_take(struct vm_freerg_bins *fb, unsigned long size, struct vm_rg_struct *newrg)
+{
+  struct vm_rg_struct *best;
+  int cls;
+  uint32_t upper;
+
+  if (size == 0)
+    return -1;
+
+  cls = vm_freerg_class(size);
+  for (best = fb->bin[cls]; best != NULL; best = best->rg_next)
+    if (best->rg_end - best->rg_start >= size)
+      break;
+
+  upper = (cls + 1 < VM_FREERG_NBINS) ? fb->bitmap & ~(BIT(cls + 1) - 1) : 0;
+  if (best == NULL && upper != 0)
+    best = fb->bin[__builtin_ctz(upper)];
+
+  if (best == NULL)
+    return -1;
+
+  newrg->rg_start = best->rg_start;
+  newrg->rg_end = best->rg_start + size;
+
+  vm_freerg_unlink(fb, best);
+  if (best->rg_end > newrg->rg_end)
+  { /* Neighbours of the remainder are in use, no merge needed */
+    best->rg_start = newrg->rg_end;
+    vm_freerg_link(fb, best);
+  }
+  else
+    free(best);
+
+  return 0;
+}
+
+/*vm_freerg_tail - length of the free region ending at @addr, 0 if none
+*@fb: free region bins
+*@addr: address, usually the sbrk of the area
+*
+*/
+unsigned long vm_freerg_tail(struct vm_freerg_bins *fb, unsigned long addr)
+{
+  struct vm_rg_struct *rg = vm_freerg_ending_at(fb, addr);
+
+  return rg ? rg->rg_end - rg->rg_start : 0;
+}
+
+/*vm_freerg_frag - external fragmentation of the free space in permille
+*@fb: free region bins
+*
+*0 when all free bytes are in one region, close to 1000 when the largest
+*free region is a tiny part of them
+*/
+unsigned long vm_freerg_frag(struct vm_freerg_bins *fb)
+{
+  struct vm_rg_struct *rgit;
+  unsigned long largest = 0;
+
+  if (fb->bitmap == 0 || fb->free_bytes == 0)
+    return 0;
+
+  for (rgit = fb->bin[31 - __builtin_clz(fb->bitmap)]; rgit != NULL; rgit = rgit->rg_next)
+    if (rgit->rg_end - rgit->rg_start > largest)
+      largest = rgit->rg_end - rgit->rg_start;
+
+  return 1000 - largest * 1000 / fb->free_bytes;
+}
+
+// #endif
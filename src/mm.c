@@ -7,6 +7,28 @@
 #include "mm.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
+
+int paging_pgshift = PAGING_PGSHIFT_MIN;
+
+/*
+* mm_set_pagesz - choose the page size of this run
+* @size : bytes, a power of two from 256B up to 64KB
+* Only valid before any MEMPHY is formatted or mm created
+*/
+int mm_set_pagesz(int size)
+{
+  int shift;
+
+  for (shift = PAGING_PGSHIFT_MIN; shift <= PAGING_PGSHIFT_MAX; shift++)
+    if (size == (1 << shift))
+    {
+      paging_pgshift = shift;
+      return 0;
+    }
+
+  return -1;
+}
 
 /*
 * init_pte - Initialize PTE entry
@@ -33,7 +55,7 @@ int init_pte(uint32_t *pte,
     }
     else
     { // page swapped
-      SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
+      CLRBIT(*pte, PAGING_PTE_PRESENT_MASK);
       SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
       CLRBIT(*pte, PAGING_PTE_DIRTY_MASK);
 
@@ -53,7 +75,7 @@ int init_pte(uint32_t *pte,
 */
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff)
 {
-  SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
+  CLRBIT(*pte, PAGING_PTE_PRESENT_MASK);
   SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
 
   SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
@@ -71,12 +93,197 @@ int pte_set_fpn(uint32_t *pte, int fpn)
 {
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
+  CLRBIT(*pte, PAGING_PTE_SWPOFF_MASK); /* stale swap offset overlaps the FPN */
 
   SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
 
   return 0;
 }
 
+/*
+* pte_ptr - walk the page table down to the PTE of a page
+* @mm    : mm owning the page table
+* @pgn   : page number
+* @alloc : allocate the page table page if it is missing
+* Return NULL if it is missing and was not allocated
+*/
+uint32_t *pte_ptr(struct mm_struct *mm, int pgn, int alloc)
+{
+  if (mm->pgd == NULL)
+    return NULL; /* torn down, reached through a stale reverse map */
+
+  uint32_t **pgt = &mm->pgd[pgn >> PAGING_PGT_BITS];
+
+  if (*pgt == NULL)
+  {
+    if (!alloc || (*pgt = calloc(PAGING_PGT_NENT, sizeof(uint32_t))) == NULL)
+      return NULL;
+    MM_STAT_INC(pgt_alloc);
+  }
+
+  return &(*pgt)[pgn & (PAGING_PGT_NENT - 1)];
+}
+
+/*
+* pte_get - read the PTE of a page
+* @mm  : mm owning the page table
+* @pgn : page number
+* A page whose page table page is missing reads as an empty PTE
+*/
+uint32_t pte_get(struct mm_struct *mm, int pgn)
+{
+  uint32_t *pgt = (mm->pgd != NULL) ? mm->pgd[pgn >> PAGING_PGT_BITS] : NULL;
+
+  return (pgt != NULL) ? pgt[pgn & (PAGING_PGT_NENT - 1)] : 0;
+}
+
+/*
+* pte_map - PTE of a page about to be mapped
+* @mm  : mm owning the page table
+* @pgn : page number
+* A page mapped for the first time joins the mapped list of the mm, so
+* teardown costs what was mapped instead of a whole page table walk.
+* Return NULL if the page table page or the list cannot grow
+*/
+uint32_t *pte_map(struct mm_struct *mm, int pgn)
+{
+  uint32_t *pte = pte_ptr(mm, pgn, 1);
+
+  if (pte == NULL || *pte != 0)
+    return pte;
+
+  if (mm->nmapped == mm->mapped_cap)
+  {
+    int cap = mm->mapped_cap ? mm->mapped_cap * 2 : 64;
+    int *mapped = realloc(mm->mapped, cap * sizeof(int));
+
+    if (mapped == NULL)
+      return NULL;
+    mm->mapped = mapped;
+    mm->mapped_cap = cap;
+  }
+  mm->mapped[mm->nmapped++] = pgn;
+
+  return pte;
+}
+
+/*
+* tlb_lookup - translate a page through the software TLB
+* @mm  : mm owning the TLB
+* @pgn : page number
+* @fpn : returned frame number on a hit
+* A page of a large page is also found through the entry of its block.
+* Return 0 on a hit, -1 on a miss
+*/
+int tlb_lookup(struct mm_struct *mm, int pgn, int *fpn)
+{
+  struct tlb_entry *te = &mm->tlb[pgn & (MM_TLB_SZ - 1)];
+  int lpn = pgn >> PAGING_LPAGE_ORDER;
+  struct tlb_entry *le = &mm->ltlb[lpn & (MM_LTLB_SZ - 1)];
+
+  if (te->pgn == pgn)
+    *fpn = te->fpn;
+  else if (le->pgn == lpn)
+  {
+    *fpn = le->fpn + (pgn & (PAGING_LPAGE_NR - 1));
+    MM_STAT_INC(tlb_lhit);
+  }
+  else
+  {
+    MM_STAT_INC(tlb_miss);
+    return -1;
+  }
+
+  MM_STAT_INC(tlb_hit);
+  return 0;
+}
+
+/*
+* tlb_lfill - cache a large page if the block of a page is one
+* @mm  : mm owning the TLB
+* @pgn : page number
+* @fpn : frame number
+* Every page of the block must be resident, private and on the frame
+* at the same offset of an aligned run. A page evicted or copied on
+* write breaks that and the block goes back to one entry per page
+*/
+static void tlb_lfill(struct mm_struct *mm, int pgn, int fpn)
+{
+  int base = pgn & ~(PAGING_LPAGE_NR - 1);
+  int fbase = fpn - (pgn - base);
+  struct tlb_entry *le = &mm->ltlb[(base >> PAGING_LPAGE_ORDER) & (MM_LTLB_SZ - 1)];
+  uint32_t pte;
+  int i;
+
+  if (fbase & (PAGING_LPAGE_NR - 1))
+    return;
+
+  for (i = 0; i < PAGING_LPAGE_NR; i++)
+  {
+    pte = pte_get(mm, base + i);
+    if (!PAGING_PAGE_PRESENT(pte) || !(pte & PAGING_PTE_LARGE_MASK) ||
+        (pte & (PAGING_PTE_COW_MASK | PAGING_PTE_SHM_MASK)) ||
+        PAGING_PTE_FPN(pte) != fbase + i)
+      return;
+  }
+
+  le->pgn = base >> PAGING_LPAGE_ORDER;
+  le->fpn = fbase;
+}
+
+/*
+* tlb_fill - remember the translation found by a page table walk
+* @mm  : mm owning the TLB
+* @pgn : page number
+* @fpn : frame number
+*/
+void tlb_fill(struct mm_struct *mm, int pgn, int fpn)
+{
+  struct tlb_entry *te = &mm->tlb[pgn & (MM_TLB_SZ - 1)];
+  int lpn = pgn >> PAGING_LPAGE_ORDER;
+  struct tlb_entry *le = &mm->ltlb[lpn & (MM_LTLB_SZ - 1)];
+
+  /* A page copied on write moved off the run of its block */
+  if (le->pgn == lpn && le->fpn + (pgn & (PAGING_LPAGE_NR - 1)) != fpn)
+    le->pgn = -1;
+  else if (le->pgn != lpn && (pte_get(mm, pgn) & PAGING_PTE_LARGE_MASK))
+    tlb_lfill(mm, pgn, fpn);
+
+  te->pgn = pgn;
+  te->fpn = fpn;
+}
+
+/*
+* tlb_flush_page - drop the translation of a page whose PTE changed
+* @mm  : mm owning the TLB
+* @pgn : page number
+*/
+void tlb_flush_page(struct mm_struct *mm, int pgn)
+{
+  struct tlb_entry *te = &mm->tlb[pgn & (MM_TLB_SZ - 1)];
+  int lpn = pgn >> PAGING_LPAGE_ORDER;
+  struct tlb_entry *le = &mm->ltlb[lpn & (MM_LTLB_SZ - 1)];
+
+  if (te->pgn == pgn)
+    te->pgn = -1;
+  if (le->pgn == lpn)
+    le->pgn = -1;
+}
+
+/*
+* tlb_flush_all - drop every translation of an mm
+* @mm  : mm owning the TLB
+*/
+void tlb_flush_all(struct mm_struct *mm)
+{
+  int i;
+
+  for (i = 0; i < MM_TLB_SZ; i++)
+    mm->tlb[i].pgn = -1;
+  for (i = 0; i < MM_LTLB_SZ; i++)
+    mm->ltlb[i].pgn = -1;
+}
+
 /*
 * vmap_page_range - map a range of page at aligned address
 */
@@ -115,22 +322,33 @@ int vmap_page_range(struct pcb_t *caller,           // process call
 
   /* TODO map range of frame to address space
   *      [addr to addr + pgnum*PAGING_PAGESZ
-  *      in page table caller->mm->pgd[]
+  *      in the page table of caller->mm
   */
   for (; pgit < pgnum; ++pgit)
   {
-    if(frames == NULL) {
+    uint32_t *pte = pte_map(caller->mm, pgn + pgit);
+
+    if(frames == NULL || pte == NULL) {
+      return -1;
+    }
+
+  /* Tracking for later page replacement activities (if needed)
+  * Enqueue new usage page, the pages left unmapped fault in later */
+    if (pgrep_insert(caller->mm, pgn + pgit) != 0) {
+      for (; frames != NULL; frames = fpit) {
+        fpit = frames->fp_next;
+        MEMPHY_put_freefp(caller->mram, frames->fpn);
+        free(frames);
+      }
       return -1;
     }
 
     fpit = frames;
-    pte_set_fpn(&caller->mm->pgd[pgn + pgit], fpit->fpn);
+    pte_set_fpn(pte, fpit->fpn);
+    tlb_flush_page(caller->mm, pgn + pgit);
+    MEMPHY_set_owner(caller->mram, fpit->fpn, caller->mm, pgn + pgit);
     frames = frames->fp_next;
     free(fpit);
-
-  /* Tracking for later page replacement activities (if needed)
-  * Enqueue new usage page */
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgn + pgit);
   }
 
   return 0;
@@ -141,6 +359,8 @@ int vmap_page_range(struct pcb_t *caller,           // process call
 * @caller    : caller
 * @req_pgnum : request page num
 * @frm_lst   : frame list
+* A request past the RSS limit of the caller gets no frame, its pages
+* fault in one by one and replace within the working set
 */
 
 int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst) {
@@ -151,6 +371,9 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
   // Initialize the return list as empty
   *frm_lst = NULL;
 
+  if (caller->mm->rss_max > 0 && caller->mm->rss + req_pgnum > caller->mm->rss_max)
+    return -1;
+
   for (pgit = 0; pgit < req_pgnum; pgit++) {
       // Attempt to get a free frame
       if (MEMPHY_get_freefp(caller->mram, &fpn) != 0) {
@@ -159,6 +382,7 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
           while (head != NULL) {
               struct framephy_struct *temp = head;
               head = head->fp_next;
+              MEMPHY_put_freefp(caller->mram, temp->fpn);
               free(temp);
           }
           return (pgit == 0) ? -1 : -3000; // Return appropriate error code
@@ -168,9 +392,11 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
       newfp_str = malloc(sizeof(struct framephy_struct));
       if (newfp_str == NULL) {
           // Free already allocated frames on failure
+          MEMPHY_put_freefp(caller->mram, fpn);
           while (head != NULL) {
               struct framephy_struct *temp = head;
               head = head->fp_next;
+              MEMPHY_put_freefp(caller->mram, temp->fpn);
               free(temp);
           }
           return -1; // Memory allocation failure
@@ -235,23 +461,12 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
 * @srcfpn : source physical page number (FPN)
 * @mpdst  : destination memphy
 * @dstfpn : destination physical page number (FPN)
+* Return the time slots the copy takes, -1 on error
 **/
 int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                   struct memphy_struct *mpdst, int dstfpn)
 {
-  int cellidx;
-  int addrsrc, addrdst;
-  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
-  {
-    addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING_PAGESZ + cellidx;
-
-    BYTE data;
-    MEMPHY_read(mpsrc, addrsrc, &data);
-    MEMPHY_write(mpdst, addrdst, data);
-  }
-
-  return 0;
+  return MEMPHY_copy_frames(mpsrc, srcfpn, mpdst, dstfpn, 1);
 }
 
 /*
@@ -270,7 +485,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
     return -1;
   }
 
-  mm->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
+  mm->pgd = calloc(PAGING_PGD_NENT, sizeof(uint32_t *));
   if(mm->pgd == NULL){
     free(vma0);
     return -1;
@@ -281,13 +496,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma0->vm_start = 0;
   vma0->vm_end = vma0->vm_start;
   vma0->sbrk = vma0->vm_start;
-  struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
-  if(first_rg == NULL){
-    free(vma0);
-    free(mm->pgd);
-    return -1;
-  }
-  enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
+  vm_freerg_init(&vma0->vm_freerg);
 
   /* TODO update VMA0 next */
   vma0->vm_next = NULL;
@@ -298,6 +507,16 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   /* TODO: update mmap */
   mm->mmap = vma0;
 
+  mm->mapped = NULL;
+  mm->nmapped = mm->mapped_cap = 0;
+  mm->shm = NULL;
+  mm->ra_next = -1;
+  mm->ra_win = 0;
+  mm->rss = mm->rss_peak = mm->rss_max = 0;
+  tlb_flush_all(mm);
+  pgrep_init(mm);
+  pthread_mutex_init(&mm->mm_lock, NULL);
+
   return 0;
 }
 
@@ -413,12 +632,12 @@ int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
 
   for (pgit = pgn_start; pgit < pgn_end; pgit++)
   {
-    printf("%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
+    printf("%08ld: %08x\n", pgit * sizeof(uint32_t), pte_get(caller->mm, pgit));
   }
 
   for (pgit = pgn_start; pgit < pgn_end; pgit++)
   {
-    printf("Page Number: %d -> Frame Number: %d\n", pgit, PAGING_FPN(caller->mm->pgd[pgit]));
+    printf("Page Number: %d -> Frame Number: %d\n", pgit, PAGING_FPN(pte_get(caller->mm, pgit)));
   }
   printf("================================================================\n");
 
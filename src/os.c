@@ -4,11 +4,13 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "libmem.h"
 
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <getopt.h>
 
 static int time_slot;
 static int num_cpus;
@@ -17,6 +19,9 @@ static int done = 0;
 #ifdef MM_PAGING
 static int memramsz;
 static int memswpsz[PAGING_MAX_MMSWP];
+static int swp_seek_rate; /* swap devices are sequential when non zero */
+static const char *swp_file; /* swap device i is backed by <swp_file>.i if set */
+static int rss_prio[MAX_PRIO]; /* RSS limit in pages per priority, 0 for none */
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
@@ -35,6 +40,9 @@ static struct ld_args{
 #ifdef MLQ_SCHED
 	unsigned long * prio;
 #endif
+#ifdef MM_PAGING
+	int * rss_max; /* -1 for the limit of its priority */
+#endif
 } ld_processes;
 int num_processes;
 
@@ -56,15 +64,14 @@ static void * cpu_routine(void * args) {
 			/* No process is running, the we load new process from
 		 	* ready queue */
 			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
-                           continue; /* First load failed. skip dummy load */
-                        }
-		}else if (proc->pc == proc->code->size) {
+		}else if (proc->pc == proc->code->size && proc->stall == 0) {
 			/* The porcess has finish it job */
 			printf("\tCPU %d: Processed %2d has finished\n",
 				id ,proc->pid);
-			free(proc);
+#ifdef MM_PAGING
+			free_pcb_memph(proc);
+#endif
+			free_pcb(proc);
 			proc = get_proc();
 			time_left = 0;
 		}else if (time_left == 0) {
@@ -76,7 +83,7 @@ static void * cpu_routine(void * args) {
 		}
 		
 		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
+		if (proc == NULL && done && queue_empty()) {
 			/* No process to run, exit */
 			printf("\tCPU %d stopped\n", id);
 			break;
@@ -91,8 +98,12 @@ static void * cpu_routine(void * args) {
 			time_left = time_slot;
 		}
 		
-		/* Run current process */
-		run(proc);
+		/* Run current process, or let it keep paying for a
+		 * multi-slot instruction */
+		if (proc->stall > 0)
+			proc->stall--;
+		else
+			run(proc);
 		time_left--;
 		next_slot(timer_id);
 	}
@@ -113,6 +124,12 @@ static void * ld_routine(void * args) {
 	printf("ld_routine\n");
 	while (i < num_processes) {
 		struct pcb_t * proc = load(ld_processes.path[i]);
+		if (proc == NULL) {
+			/* load() said why, the other processes still run */
+			free(ld_processes.path[i]);
+			i++;
+			continue;
+		}
 #ifdef MLQ_SCHED
 		proc->prio = ld_processes.prio[i];
 #endif
@@ -120,11 +137,16 @@ static void * ld_routine(void * args) {
 			next_slot(timer_id);
 		}
 #ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
+		proc->mm = &proc->cold->mm_store;
 		init_mm(proc->mm, proc);
 		proc->mram = mram;
-		proc->mswp = mswp;
+		proc->cold->mswp = mswp;
 		proc->active_mswp = active_mswp;
+		proc->mm->rss_max = ld_processes.rss_max[i];
+#ifdef MLQ_SCHED
+		if (proc->mm->rss_max < 0)
+			proc->mm->rss_max = rss_prio[proc->prio];
+#endif
 #endif
 		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
 			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
@@ -135,6 +157,9 @@ static void * ld_routine(void * args) {
 	}
 	free(ld_processes.path);
 	free(ld_processes.start_time);
+#ifdef MM_PAGING
+	free(ld_processes.rss_max);
+#endif
 	done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
@@ -173,6 +198,7 @@ static void read_config(const char * path) {
 
        fscanf(file, "\n"); /* Final character */
 #endif
+	ld_processes.rss_max = (int*)malloc(sizeof(int) * num_processes);
 #endif
 
 #ifdef MLQ_SCHED
@@ -186,24 +212,144 @@ static void read_config(const char * path) {
 		strcat(ld_processes.path[i], "input/proc/");
 		char proc[100];
 #ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
+		fscanf(file, "%lu %s %lu", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
+#else
+		fscanf(file, "%lu %s", &ld_processes.start_time[i], proc);
+#endif
+#ifdef MM_PAGING
+		/* An optional last field is the RSS limit of the process in pages */
+		char rest[100];
+		ld_processes.rss_max[i] = -1;
+		if (fgets(rest, sizeof(rest), file) != NULL)
+			sscanf(rest, "%d", &ld_processes.rss_max[i]);
 #else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
+		fscanf(file, "\n");
 #endif
 		strcat(ld_processes.path[i], proc);
 	}
 }
 
+#ifdef MM_PAGING
+/* RSS limit of --rss=[PRIO:]PAGES, every priority without PRIO */
+static int set_rss_limit(const char * arg) {
+	int prio, pages;
+
+	if (sscanf(arg, "%d:%d", &prio, &pages) == 2) {
+		if (prio < 0 || prio >= MAX_PRIO || pages < 0)
+			return -1;
+		rss_prio[prio] = pages;
+		return 0;
+	}
+	if (sscanf(arg, "%d", &pages) != 1 || pages < 0)
+		return -1;
+	for (prio = 0; prio < MAX_PRIO; prio++)
+		rss_prio[prio] = pages;
+	return 0;
+}
+#endif
+
+static void usage(void) {
+	printf("Usage: os [options] [path to configure file]\n");
+#ifdef MM_PAGING
+	printf("  -r, --pgrep=POLICY   page replacement: fifo, clock, lru, arc (fifo)\n");
+	printf("  -g, --global         replace pages of any process, not only the faulting one\n");
+	printf("  -s, --seqswap=RATE   sequential swap devices, a seek crosses RATE bytes per slot\n");
+	printf("  -w, --swap=MODE      swap placement: stripe, least, tier (stripe)\n");
+	printf("  -f, --swapfile=PATH  back swap device i with the file PATH.i, unlinked once mapped\n");
+	printf("  -d, --demand         demand paging, alloc maps frames on first touch only\n");
+	printf("  -p, --pagesz=BYTES   page size, a power of two from 256 to 65536 (256)\n");
+	printf("  -l, --large          map aligned blocks of %d pages of the heap as large pages\n",
+		PAGING_LPAGE_NR);
+	printf("  -a, --readahead=MAX  read up to MAX swapped pages ahead of sequential faults\n");
+	printf("  -m, --rss=PAGES      most resident pages per process, PRIO:PAGES for one priority\n");
+#endif
+}
+
 int main(int argc, char * argv[]) {
+	static const struct option long_opts[] = {
+		{"pgrep", required_argument, NULL, 'r'},
+		{"global", no_argument, NULL, 'g'},
+		{"seqswap", required_argument, NULL, 's'},
+		{"swap", required_argument, NULL, 'w'},
+		{"swapfile", required_argument, NULL, 'f'},
+		{"demand", no_argument, NULL, 'd'},
+		{"pagesz", required_argument, NULL, 'p'},
+		{"large", no_argument, NULL, 'l'},
+		{"readahead", required_argument, NULL, 'a'},
+		{"rss", required_argument, NULL, 'm'},
+		{NULL, 0, NULL, 0}
+	};
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "r:gs:w:f:dp:la:m:", long_opts, NULL)) != -1) {
+		switch (opt) {
+#ifdef MM_PAGING
+		case 'r':
+			if (pgrep_select(optarg) != 0) {
+				printf("Unknown page replacement policy %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'g':
+			pgrep_global = 1;
+			break;
+		case 's':
+			swp_seek_rate = atoi(optarg);
+			if (swp_seek_rate <= 0) {
+				printf("Invalid seek rate %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'w':
+			if (swp_select(optarg) != 0) {
+				printf("Unknown swap placement %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'f':
+			swp_file = optarg;
+			break;
+		case 'd':
+			mm_demand = 1;
+			break;
+		case 'p':
+			if (mm_set_pagesz(atoi(optarg)) != 0) {
+				printf("Invalid page size %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'l':
+			mm_lpage = 1;
+			break;
+		case 'a':
+			mm_readahead = atoi(optarg);
+			if (mm_readahead <= 0) {
+				printf("Invalid read-ahead window %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'm':
+			if (set_rss_limit(optarg) != 0) {
+				printf("Invalid RSS limit %s\n", optarg);
+				return 1;
+			}
+			break;
+#endif
+		default:
+			usage();
+			return 1;
+		}
+	}
+
 	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	if (optind != argc - 1) {
+		usage();
 		return 1;
 	}
 	char path[100];
 	path[0] = '\0';
 	strcat(path, "input/");
-	strcat(path, argv[1]);
+	strcat(path, argv[optind]);
 	read_config(path);
 
 	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
@@ -226,21 +372,55 @@ int main(int argc, char * argv[]) {
 
 	struct memphy_struct mram;
 	struct memphy_struct mswp[PAGING_MAX_MMSWP];
+	struct memphy_struct *mswp_tbl[PAGING_MAX_MMSWP];
+	int sit;
+
+	/* Larger devices would have frames the PTE cannot address */
+	if (memramsz > PAGING_MEMRAMSZ) {
+		printf("MEMRAM of %d bytes, at most %d are addressable\n",
+			memramsz, PAGING_MEMRAMSZ);
+		return 1;
+	}
+	if (memramsz < PAGING_PAGESZ) {
+		printf("MEMRAM of %d bytes, smaller than a page of %d bytes\n",
+			memramsz, PAGING_PAGESZ);
+		return 1;
+	}
+	for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+		if (memswpsz[sit] > PAGING_MEMSWPSZ) {
+			printf("MEMSWP %d of %d bytes, at most %d are addressable\n",
+				sit, memswpsz[sit], PAGING_MEMSWPSZ);
+			return 1;
+		}
 
 	/* Create MEM RAM */
-	init_memphy(&mram, memramsz, rdmflag);
+	if (init_memphy(&mram, memramsz, rdmflag) != 0)
+		return 1;
 
         /* Create all MEM SWAP */ 
-	int sit;
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+	       /* The fast tier stays random access */
+	       int seq = swp_seek_rate && !(swp_mode == SWP_TIER && sit == 0);
+
+	       char swp_path[256];
+	       const char *path = NULL;
+
+	       if (swp_file != NULL && memswpsz[sit] > 0) {
+		       snprintf(swp_path, sizeof(swp_path), "%s.%d", swp_file, sit);
+		       path = swp_path;
+	       }
+	       if (init_memphy_file(&mswp[sit], memswpsz[sit], seq ? 0 : rdmflag, path) != 0)
+		       return 1;
+	       MEMPHY_set_seek_rate(&mswp[sit], seq ? swp_seek_rate : 0);
+	       mswp_tbl[sit] = &mswp[sit];
+	}
 
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
 
 	mm_ld_args->timer_id = ld_event;
 	mm_ld_args->mram = (struct memphy_struct *) &mram;
-	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
+	mm_ld_args->mswp = mswp_tbl;
 	mm_ld_args->active_mswp = (struct memphy_struct *) &mswp[0];
         mm_ld_args->active_mswp_id = 0;
 #endif
@@ -268,6 +448,10 @@ int main(int argc, char * argv[]) {
 	/* Stop timer */
 	stop_timer();
 
+#if defined(MM_PAGING) && defined(MM_STATS)
+	mm_stats_dump(&mram);
+#endif
+
 	return 0;
 
 }
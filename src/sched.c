@@ -20,7 +20,7 @@ int queue_empty(void) {
 	unsigned long prio;
 	for (prio = 0; prio < MAX_PRIO; prio++)
 		if(!empty(&mlq_ready_queue[prio])) 
-			return -1;
+			return 0;
 #endif
 	return (empty(&ready_queue) && empty(&run_queue));
 }
@@ -88,9 +88,9 @@ struct pcb_t * get_proc(void) {
 
 void put_proc(struct pcb_t * proc) {
 	if(proc == NULL) return;
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = & running_list;
+	proc->cold->ready_queue = &ready_queue;
+	proc->cold->mlq_ready_queue = mlq_ready_queue;
+	proc->cold->running_list = & running_list;
 
 	/* TODO: put running proc to running_list */
 	pthread_mutex_lock(&queue_lock);
@@ -102,9 +102,9 @@ void put_proc(struct pcb_t * proc) {
 
 void add_proc(struct pcb_t * proc) {
 	if(proc == NULL) return;
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = & running_list;
+	proc->cold->ready_queue = &ready_queue;
+	proc->cold->mlq_ready_queue = mlq_ready_queue;
+	proc->cold->running_list = & running_list;
 
 	/* TODO: put running proc to running_list */
 	pthread_mutex_lock(&queue_lock);
@@ -135,8 +135,8 @@ struct pcb_t * get_proc(void) {
 
 void put_proc(struct pcb_t * proc) {
 	if(proc == NULL) return;
-	proc->ready_queue = &ready_queue;
-	proc->running_list = & running_list;
+	proc->cold->ready_queue = &ready_queue;
+	proc->cold->running_list = & running_list;
 
 	/* TODO: put running proc to running_list */
 	pthread_mutex_lock(&queue_lock);
@@ -150,8 +150,8 @@ void put_proc(struct pcb_t * proc) {
 
 void add_proc(struct pcb_t * proc) {
 	if(proc == NULL) return;
-	proc->ready_queue = &ready_queue;
-	proc->running_list = & running_list;
+	proc->cold->ready_queue = &ready_queue;
+	proc->cold->running_list = & running_list;
 
 	/* TODO: put running proc to running_list */
 	pthread_mutex_lock(&queue_lock);
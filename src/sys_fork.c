@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+* Source Code License Grant: The authors hereby grant to Licensee
+* personal permission to use and modify the Licensed Source Code
+* for the sole purpose of studying while attending the course CO2018.
+*/
+
+#include "common.h"
+#include "syscall.h"
+#include "stdio.h"
+#include "libmem.h"
+#include "loader.h"
+#include "sched.h"
+#include "mm.h"
+
+/*
+ * The child is a copy of the caller that resumes right after the
+ * syscall. Its pages are shared copy on write, see fork_pcb_memph.
+ * Return the child pid to the caller, -1 if it could not be made
+ */
+int __sys_fork(struct pcb_t *caller, struct sc_regs *regs)
+{
+    struct pcb_t *child = dup_pcb(caller);
+
+    if (child == NULL)
+    {
+        printf("fork: out of PCB slots, PID %d\n", caller->pid);
+        return -1;
+    }
+
+#ifdef MM_PAGING
+    child->mm = &child->cold->mm_store;
+    init_mm(child->mm, child);
+    child->mram = caller->mram;
+    child->cold->mswp = caller->cold->mswp;
+    child->cold->active_mswp_id = caller->cold->active_mswp_id;
+    child->active_mswp = caller->active_mswp;
+    child->mm->rss_max = caller->mm->rss_max;
+
+    if (fork_pcb_memph(caller, child) != 0)
+    {
+        printf("fork: out of swap, PID %d\n", caller->pid);
+        free_pcb_memph(child);
+        free_pcb(child);
+        return -1;
+    }
+#endif
+
+    printf("\tPID %d forked child PID %d\n", caller->pid, child->pid);
+    add_proc(child);
+    return child->pid;
+}
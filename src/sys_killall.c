@@ -15,41 +15,51 @@
 #include "string.h"
 #include "queue.h"
 #include "stdlib.h"
+#include "loader.h"
+#include "mm.h"
 
 
 int __sys_killall(struct pcb_t *caller, struct sc_regs *regs)
 {
     char proc_name[100];
-    uint32_t data;
+    char name[100 - sizeof("input/proc/") + 1];
     uint32_t memrg = regs->a1;
+    struct vm_rg_struct *rg = get_symrg_byid(caller->mm, memrg);
+    int rgsz = (rg != NULL) ? rg->rg_end - rg->rg_start : 0;
+    int len = 0, found = 0;
     int i = 0;
-    data = 0;
-    while (data != -1)
+
+    /* Fetch the name a vector at a time, up to the -1 terminator */
+    while (!found && len < rgsz && len < sizeof(name) - 1)
     {
-        libread(caller, memrg, i, &data);
-        proc_name[i] = data;
-        if (data == -1)
-            proc_name[i] = '\0';
-        i++;
+        int n = VREG_SZ;
+        if (n > rgsz - len)
+            n = rgsz - len;
+        if (n > sizeof(name) - 1 - len)
+            n = sizeof(name) - 1 - len;
+        if (libreadv(caller, memrg, len, n, &name[len]) != 0)
+            break;
+        for (i = len; i < len + n && !found; i++)
+            found = (name[i] == -1);
+        len = found ? i - 1 : len + n;
     }
-    char temp[12] = "input/proc/";
-    strcat(temp, proc_name);
-    strcpy(proc_name, temp);
+    name[len] = '\0';
+    snprintf(proc_name, sizeof(proc_name), "input/proc/%s", name);
     printf("The procname retrieved from memregionid %d is \"%s\"\n", memrg, proc_name);
 
     int terminated_count = 0;
     struct pcb_t *proc = NULL;
 
-    if (caller->running_list != NULL)
+    if (caller->cold->running_list != NULL)
     {
-        struct queue_t *running = caller->running_list;
+        struct queue_t *running = caller->cold->running_list;
 
         if (running->size > 0)
         {
             for (i = running->size - 1; i >= 0; i--)
             {
                 proc = running->proc[i];
-                if (proc != NULL && strcmp(proc->path, proc_name) == 0)
+                if (proc != NULL && strcmp(proc->cold->path, proc_name) == 0)
                 {
                     int j;
                     for (j = i; j < running->size - 1; j++)
@@ -57,7 +67,7 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs *regs)
                         running->proc[j] = running->proc[j + 1];
                     }
                     running->size--;
-                    // free(proc);
+                    // free_pcb(proc);
 
                     terminated_count++;
                 }
@@ -66,18 +76,18 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs *regs)
     }
 #ifdef MLQ_SCHED
     // MLQ scheduler has multiple priority queues
-    if (caller->mlq_ready_queue != NULL)
+    if (caller->cold->mlq_ready_queue != NULL)
     {
         for (int prio = 0; prio < MAX_PRIO; prio++)
         {
-            struct queue_t *ready_q = &(caller->mlq_ready_queue[prio]);
+            struct queue_t *ready_q = &(caller->cold->mlq_ready_queue[prio]);
             if (ready_q != NULL && ready_q->size > 0)
             {
                 // Iterate backwards for safe removal
                 for (i = ready_q->size - 1; i >= 0; i--)
                 {
                     proc = ready_q->proc[i];
-                    if (proc != NULL && strcmp(proc->path, proc_name) == 0)
+                    if (proc != NULL && strcmp(proc->cold->path, proc_name) == 0)
                     {
                         // Remove the process from the queue
                         int j;
@@ -86,7 +96,8 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs *regs)
                             ready_q->proc[j] = ready_q->proc[j + 1];
                         }
                         ready_q->size--;
-                        free(proc);
+                        free_pcb_memph(proc);
+                        free_pcb(proc);
                         terminated_count++;
                     }
                 }
@@ -95,16 +106,16 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs *regs)
     }
 #else
     // Single ready queue
-    if (caller->ready_queue != NULL)
+    if (caller->cold->ready_queue != NULL)
     {
-        struct queue_t *ready_q = caller->ready_queue;
+        struct queue_t *ready_q = caller->cold->ready_queue;
         if (ready_q->size > 0)
         {
             // Iterate backwards for safe removal
             for (i = ready_q->size - 1; i >= 0; i--)
             {
                 proc = ready_q->proc[i];
-                if (proc != NULL && strcmp(proc->path, proc_name) == 0)
+                if (proc != NULL && strcmp(proc->cold->path, proc_name) == 0)
                 {
                     // Remove the process from the queue
                     int j;
@@ -113,7 +124,8 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs *regs)
                         ready_q->proc[j] = ready_q->proc[j + 1];
                     }
                     ready_q->size--;
-                    free(proc);
+                    free_pcb_memph(proc);
+                    free_pcb(proc);
                     terminated_count++;
                 }
             }
@@ -21,14 +21,17 @@ int __sys_memmap(struct pcb_t *caller, struct sc_regs* regs)
 
    switch (memop) {
    case SYSMEM_MAP_OP:
-            /* Reserved process case*/
+            /* Attach shared memory segment a2, a3 bytes, to region a4 */
+            printf("Map shared memory %d size %d to region %d\n", regs->a2, regs->a3, regs->a4);
+            if (shm_attach(caller, regs->a2, regs->a3, regs->a4) != 0)
+               return -1;
             break;
    case SYSMEM_INC_OP:
             inc_vma_limit(caller, regs->a2, regs->a3);
             break;
    case SYSMEM_SWP_OP:
             printf("Swap page %d with %d\n", regs->a2, regs->a3);
-            __mm_swap_page(caller, regs->a2, regs->a3);
+            __mm_swap_page(caller, regs->a2, regs->a4, regs->a3);
             break;
    case SYSMEM_IO_READ:
             printf("Read from memphy %d\n", regs->a2);